@@ -0,0 +1,929 @@
+/*
+ * Copyright (c) 2007-2011, Lloyd Hilaiel <lloyd@hilaiel.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/* clock_gettime and threads are POSIX, beyond the c99 this is built as,
+ * and pinning to a processor is a GNU extension */
+#ifdef __linux__
+#  define _GNU_SOURCE
+#elif !defined(WIN32)
+#  define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "bench.h"
+
+#include <yajl/yajl_gen.h>
+#include <yajl/yajl_tree.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#  include <windows.h>
+#else
+#  include <time.h>
+#  include <pthread.h>
+#  include <unistd.h>
+#  include <sys/resource.h>
+#endif
+#ifdef __linux__
+#  include <sched.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <linux/perf_event.h>
+#endif
+
+double
+bench_now(void)
+{
+#ifdef WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double) now.QuadPart * 1e9 / (double) freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+#endif
+}
+
+/* two sided 95% points of Student's t distribution, by degrees of
+ * freedom.  beyond the table the normal distribution is close enough */
+static const double tTable[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+/* the two sided 95% point of Student's t distribution for df degrees of
+ * freedom, which needn't be whole */
+static double
+bench_t_critical(double df)
+{
+    if (df < 1.0) return tTable[0];
+    if (df > sizeof(tTable) / sizeof(tTable[0])) return 1.96;
+    return tTable[(unsigned int) df - 1];
+}
+
+void
+bench_summarize(const double * samples, unsigned int n,
+                bench_summary * summary)
+{
+    unsigned int i;
+    double sum = 0.0, sq = 0.0;
+
+    memset((void *) summary, 0, sizeof(bench_summary));
+    if (n == 0) return;
+
+    for (i = 0; i < n; i++) sum += samples[i];
+    summary->mean = sum / n;
+    if (n == 1) return;
+
+    for (i = 0; i < n; i++) {
+        double d = samples[i] - summary->mean;
+        sq += d * d;
+    }
+    summary->stddev = sqrt(sq / (n - 1));
+    summary->ci = bench_t_critical(n - 1) * summary->stddev /
+        sqrt((double) n);
+}
+
+/* summarize a rate derived from each trial's time per iteration */
+static void
+bench_summarize_rate(const bench_result * result, double perIter,
+                     double scale, bench_summary * summary)
+{
+    double * rates = (double *) malloc(result->trials * sizeof(double));
+    unsigned int i;
+
+    for (i = 0; i < result->trials; i++) {
+        rates[i] = perIter * scale / result->samples[i];
+    }
+    bench_summarize(rates, result->trials, summary);
+    free(rates);
+}
+
+const char * bench_counter_names[BENCH_NUM_COUNTERS] = {
+    "cycles", "instructions", "branchMisses", "l1dMisses", "llcMisses"
+};
+
+#ifdef __linux__
+static int counterFds[BENCH_NUM_COUNTERS] = { -1, -1, -1, -1, -1 };
+
+static int
+counter_open(unsigned int type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    memset((void *) &attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    /* user space only, which unprivileged processes may count */
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+int
+bench_counters_open(void)
+{
+    int n = 0;
+#ifdef __linux__
+    unsigned int i;
+
+    counterFds[bench_cycles] =
+        counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    counterFds[bench_instructions] =
+        counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    counterFds[bench_branch_misses] =
+        counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    counterFds[bench_l1d_misses] =
+        counter_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                     (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    counterFds[bench_llc_misses] =
+        counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    for (i = 0; i < BENCH_NUM_COUNTERS; i++) n += counterFds[i] >= 0;
+#endif
+    return n;
+}
+
+void
+bench_counters_close(void)
+{
+#ifdef __linux__
+    unsigned int i;
+    for (i = 0; i < BENCH_NUM_COUNTERS; i++) {
+        if (counterFds[i] >= 0) close(counterFds[i]);
+        counterFds[i] = -1;
+    }
+#endif
+}
+
+static void
+counters_start(void)
+{
+#ifdef __linux__
+    unsigned int i;
+    for (i = 0; i < BENCH_NUM_COUNTERS; i++) {
+        if (counterFds[i] < 0) continue;
+        ioctl(counterFds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counterFds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+/* stop the counters and record their counts over iters iterations */
+static void
+counters_stop(bench_counts * counts, unsigned long iters)
+{
+#ifdef __linux__
+    unsigned int i;
+
+    for (i = 0; i < BENCH_NUM_COUNTERS; i++) {
+        /* the value, and the times enabled and running, for scaling the
+         * value when counters had to take turns on the hardware */
+        unsigned long long v[3];
+
+        if (counterFds[i] < 0) continue;
+        ioctl(counterFds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counterFds[i], v, sizeof(v)) != sizeof(v) || v[2] == 0) {
+            continue;
+        }
+        counts->available[i] = 1;
+        counts->perIter[i] = (double) v[0] * ((double) v[1] / v[2]) / iters;
+    }
+#endif
+}
+
+/* summarize the trials' samples */
+static void
+bench_finish(bench_result * result)
+{
+    bench_summarize(result->samples, result->trials, &(result->nsPerIter));
+    bench_summarize_rate(result, (double) result->work.bytes,
+                         1e9 / (1024.0 * 1024.0), &(result->mbPerSec));
+    bench_summarize_rate(result, (double) result->work.docs, 1e9,
+                         &(result->docsPerSec));
+    if (result->work.tokens) {
+        bench_summarize(result->samples, result->trials,
+                        &(result->nsPerToken));
+        result->nsPerToken.mean /= result->work.tokens;
+        result->nsPerToken.stddev /= result->work.tokens;
+        result->nsPerToken.ci /= result->work.tokens;
+    }
+}
+
+int
+bench_run(const char * name, bench_func func, void * ctx,
+          const bench_options * opts, bench_result * result)
+{
+    unsigned int t;
+    unsigned long totalIters = 0;
+    int failed = 0;
+
+    memset((void *) result, 0, sizeof(bench_result));
+    result->name = name;
+    result->threads = 1;
+
+    if (func(ctx, &(result->work))) return 1;
+
+    result->samples = (double *) malloc(opts->trials * sizeof(double));
+    counters_start();
+    for (t = 0; t < opts->trials && !failed; t++) {
+        double start = bench_now(), elapsed;
+        unsigned long iters = 0;
+
+        do {
+            failed = func(ctx, NULL);
+            iters++;
+            elapsed = bench_now() - start;
+        } while (!failed && elapsed < opts->minTrialSecs * 1e9);
+
+        result->samples[t] = elapsed / iters;
+        result->trials++;
+        totalIters += iters;
+    }
+    /* the counters are stopped even when the benchmark failed, so they
+     * don't run on into whatever comes next */
+    counters_stop(&(result->counters), totalIters);
+
+    if (failed) {
+        bench_result_free(result);
+        return 1;
+    }
+    bench_finish(result);
+    return 0;
+}
+
+unsigned int
+bench_num_cpus(void)
+{
+#ifdef WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (unsigned int) info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned int) n : 1;
+#endif
+}
+
+#ifndef WIN32
+/* where a trial's threads wait, once warmed up, to start together.  the
+ * trial is called off, rather than left waiting, if a thread can't be
+ * started */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned int waiting;
+    int go;
+    int cancelled;
+} bench_gate;
+
+typedef struct {
+    bench_func func;
+    void * ctx;
+    double secs;
+    bench_gate * gate;
+    /* iterations per nanosecond over the trial, or negative on failure */
+    double rate;
+} bench_thread;
+
+/* wait at the gate, returning zero if the trial is cancelled */
+static int
+bench_gate_wait(bench_gate * g)
+{
+    int go;
+
+    pthread_mutex_lock(&(g->lock));
+    g->waiting++;
+    pthread_cond_broadcast(&(g->cond));
+    while (!g->go && !g->cancelled) pthread_cond_wait(&(g->cond), &(g->lock));
+    go = g->go;
+    pthread_mutex_unlock(&(g->lock));
+    return go;
+}
+
+/* once count threads are waiting, let them go, or call them off */
+static void
+bench_gate_open(bench_gate * g, unsigned int count, int cancel)
+{
+    pthread_mutex_lock(&(g->lock));
+    if (cancel) {
+        g->cancelled = 1;
+    } else {
+        while (g->waiting < count) pthread_cond_wait(&(g->cond), &(g->lock));
+        g->go = 1;
+    }
+    pthread_cond_broadcast(&(g->cond));
+    pthread_mutex_unlock(&(g->lock));
+}
+
+static void *
+bench_thread_main(void * arg)
+{
+    bench_thread * t = (bench_thread *) arg;
+    double start, elapsed = 0.0;
+    unsigned long iters = 0;
+    int failed = t->func(t->ctx, NULL);
+
+    /* warmed up, all threads start together */
+    if (!bench_gate_wait(t->gate)) {
+        t->rate = -1.0;
+        return NULL;
+    }
+    start = bench_now();
+    while (!failed) {
+        failed = t->func(t->ctx, NULL);
+        iters++;
+        elapsed = bench_now() - start;
+        if (elapsed >= t->secs * 1e9) break;
+    }
+    t->rate = failed ? -1.0 : iters / elapsed;
+    return NULL;
+}
+#endif
+
+int
+bench_run_parallel(const char * name, bench_func func, void ** ctxs,
+                   unsigned int threads, const bench_options * opts,
+                   bench_result * result)
+{
+#ifdef WIN32
+    if (threads > 1) {
+        fprintf(stderr, "threaded benchmarks need POSIX threads\n");
+        return 1;
+    }
+    return bench_run(name, func, ctxs[0], opts, result);
+#else
+    bench_thread * ts = (bench_thread *) calloc(threads,
+                                                sizeof(bench_thread));
+    pthread_t * ids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+    bench_gate gate;
+    unsigned int t, i, started;
+    int rv = 0;
+
+    memset((void *) result, 0, sizeof(bench_result));
+    result->name = name;
+    result->threads = threads;
+    result->samples = (double *) malloc(opts->trials * sizeof(double));
+    result->threadMbPerSec = (double *) calloc(threads, sizeof(double));
+
+    if (func(ctxs[0], &(result->work))) rv = 1;
+
+    for (t = 0; t < opts->trials && rv == 0; t++) {
+        double rate = 0.0;
+
+        memset((void *) &gate, 0, sizeof(gate));
+        pthread_mutex_init(&(gate.lock), NULL);
+        pthread_cond_init(&(gate.cond), NULL);
+        for (started = 0; started < threads; started++) {
+            ts[started].func = func;
+            ts[started].ctx = ctxs[started];
+            ts[started].secs = opts->minTrialSecs;
+            ts[started].gate = &gate;
+            if (pthread_create(ids + started, NULL, bench_thread_main,
+                               ts + started))
+            {
+                fprintf(stderr, "couldn't start thread %u of %u\n",
+                        started + 1, threads);
+                rv = 1;
+                break;
+            }
+        }
+        bench_gate_open(&gate, started, rv);
+        for (i = 0; i < started; i++) {
+            pthread_join(ids[i], NULL);
+            if (ts[i].rate < 0) rv = 1;
+            rate += ts[i].rate;
+            result->threadMbPerSec[i] += ts[i].rate;
+        }
+        pthread_cond_destroy(&(gate.cond));
+        pthread_mutex_destroy(&(gate.lock));
+        if (rv) break;
+
+        /* the time per iteration of the threads together */
+        result->samples[t] = 1.0 / rate;
+        result->trials++;
+    }
+
+    free(ts);
+    free(ids);
+    if (rv == 0) {
+        /* from iterations per nanosecond summed over the trials */
+        for (i = 0; i < threads; i++) {
+            result->threadMbPerSec[i] *= (double) result->work.bytes /
+                result->trials * 1e9 / (1024.0 * 1024.0);
+        }
+        bench_finish(result);
+    } else {
+        bench_result_free(result);
+    }
+    return rv;
+#endif
+}
+
+void
+bench_result_free(bench_result * result)
+{
+    free(result->samples);
+    result->samples = NULL;
+    free(result->threadMbPerSec);
+    result->threadMbPerSec = NULL;
+    if (result->latency) {
+        bench_hist_free(result->latency);
+        free(result->latency);
+        result->latency = NULL;
+    }
+    free(result->memory);
+    result->memory = NULL;
+}
+
+long
+bench_peak_rss_kb(void)
+{
+#ifdef WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) return 0;
+#  ifdef __APPLE__
+    /* in bytes, unlike everywhere else */
+    return usage.ru_maxrss / 1024;
+#  else
+    return usage.ru_maxrss;
+#  endif
+#endif
+}
+
+/* values below 2^(HIST_SUB_BITS + 1) get a bucket each, then each power of
+ * two gets 2^HIST_SUB_BITS buckets, up to 2^HIST_MAX_BITS ns */
+#define HIST_SUB_BITS 6
+#define HIST_SUB (1u << HIST_SUB_BITS)
+#define HIST_MAX_BITS 48
+#define HIST_BUCKETS (2 * HIST_SUB + (HIST_MAX_BITS - HIST_SUB_BITS) * HIST_SUB)
+
+static unsigned int
+hist_index(unsigned long long v)
+{
+    unsigned int msb = 0, shift;
+
+    if (v < 2 * HIST_SUB) return (unsigned int) v;
+    while ((v >> msb) > 1) msb++;
+    if (msb >= HIST_MAX_BITS) return HIST_BUCKETS - 1;
+    shift = msb - HIST_SUB_BITS;
+    return 2 * HIST_SUB + (shift - 1) * HIST_SUB +
+           (unsigned int) ((v >> shift) - HIST_SUB);
+}
+
+/* the highest value a bucket holds */
+static double
+hist_value(unsigned int i)
+{
+    unsigned int shift;
+
+    if (i < 2 * HIST_SUB) return (double) i;
+    shift = (i - 2 * HIST_SUB) / HIST_SUB + 1;
+    return (double) ((((unsigned long long) (i % HIST_SUB + HIST_SUB) + 1)
+                      << shift) - 1);
+}
+
+void
+bench_hist_init(bench_histogram * h)
+{
+    memset((void *) h, 0, sizeof(bench_histogram));
+    h->counts = (size_t *) calloc(HIST_BUCKETS, sizeof(size_t));
+}
+
+void
+bench_hist_free(bench_histogram * h)
+{
+    free(h->counts);
+    h->counts = NULL;
+}
+
+void
+bench_hist_record(bench_histogram * h, double ns)
+{
+    if (ns < 0) ns = 0;
+    h->counts[hist_index((unsigned long long) ns)]++;
+    if (h->total == 0 || ns < h->min) h->min = ns;
+    if (ns > h->max) h->max = ns;
+    h->sum += ns;
+    h->total++;
+}
+
+double
+bench_hist_percentile(const bench_histogram * h, double p)
+{
+    size_t want = (size_t) (p / 100.0 * h->total + 0.5), seen = 0;
+    unsigned int i;
+
+    if (want == 0) want = 1;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= want) {
+            /* no bucket value is beyond the largest value seen */
+            return hist_value(i) < h->max ? hist_value(i) : h->max;
+        }
+    }
+    return h->max;
+}
+
+int
+bench_pin_cpu(unsigned int cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set);
+#elif defined(WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(),
+                                 (DWORD_PTR) 1 << cpu) == 0;
+#else
+    return 1;
+#endif
+}
+
+void
+bench_print_header(FILE * out)
+{
+    fprintf(out, "%-26s %20s %18s %18s %10s\n", "benchmark", "MB/s",
+            "docs/s", "ns/token", "buffered");
+}
+
+void
+bench_print(FILE * out, const bench_result * result)
+{
+    char mb[32], docs[32], tok[32];
+
+    sprintf(mb, "%.1f +- %.1f", result->mbPerSec.mean, result->mbPerSec.ci);
+    sprintf(docs, "%.0f +- %.0f", result->docsPerSec.mean,
+            result->docsPerSec.ci);
+    if (result->work.tokens) {
+        sprintf(tok, "%.2f +- %.2f", result->nsPerToken.mean,
+                result->nsPerToken.ci);
+    } else {
+        strcpy(tok, "-");
+    }
+    fprintf(out, "%-26s %20s %18s %18s %10lu\n", result->name, mb, docs,
+            tok, (unsigned long) result->work.bufferedBytes);
+}
+
+void
+bench_print_counters_header(FILE * out)
+{
+    fprintf(out, "%-26s %10s %10s %6s %12s %12s %12s\n", "benchmark",
+            "cycles/B", "instr/B", "IPC", "brmiss/tok", "L1dmiss/tok",
+            "LLCmiss/tok");
+}
+
+/* format a count per unit, or a dash where it isn't known */
+static void
+format_count(char * out, const bench_counts * c, int counter, double per)
+{
+    if (c->available[counter] && per > 0) {
+        sprintf(out, "%.3f", c->perIter[counter] / per);
+    } else {
+        strcpy(out, "-");
+    }
+}
+
+void
+bench_print_counters(FILE * out, const bench_result * r)
+{
+    const bench_counts * c = &(r->counters);
+    double bytes = (double) r->work.bytes, tokens = (double) r->work.tokens;
+    char cyc[32], ins[32], ipc[32], br[32], l1[32], llc[32];
+
+    format_count(cyc, c, bench_cycles, bytes);
+    format_count(ins, c, bench_instructions, bytes);
+    if (c->available[bench_cycles] && c->available[bench_instructions] &&
+        c->perIter[bench_cycles] > 0)
+    {
+        sprintf(ipc, "%.2f", c->perIter[bench_instructions] /
+                c->perIter[bench_cycles]);
+    } else {
+        strcpy(ipc, "-");
+    }
+    format_count(br, c, bench_branch_misses, tokens);
+    format_count(l1, c, bench_l1d_misses, tokens);
+    format_count(llc, c, bench_llc_misses, tokens);
+    fprintf(out, "%-26s %10s %10s %6s %12s %12s %12s\n", r->name, cyc, ins,
+            ipc, br, l1, llc);
+}
+
+static void
+bench_json_print(void * ctx, const char * str, size_t len)
+{
+    fwrite(str, 1, len, (FILE *) ctx);
+}
+
+static void
+bench_json_key(yajl_gen g, const char * key)
+{
+    yajl_gen_string(g, (const unsigned char *) key, strlen(key));
+}
+
+static void
+bench_json_summary(yajl_gen g, const char * key,
+                   const bench_summary * summary)
+{
+    bench_json_key(g, key);
+    yajl_gen_map_open(g);
+    bench_json_key(g, "mean");
+    yajl_gen_double(g, summary->mean);
+    bench_json_key(g, "stddev");
+    yajl_gen_double(g, summary->stddev);
+    bench_json_key(g, "ci95");
+    yajl_gen_double(g, summary->ci);
+    yajl_gen_map_close(g);
+}
+
+int
+bench_write_json(const char * path, const bench_options * opts,
+                 const bench_result * results, unsigned int count)
+{
+    FILE * out = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    yajl_gen g;
+    unsigned int i, t;
+    int rv;
+
+    if (out == NULL) return 1;
+    g = yajl_gen_alloc(NULL);
+    yajl_gen_config(g, yajl_gen_beautify, 1);
+    yajl_gen_config(g, yajl_gen_print_callback, bench_json_print,
+                    (void *) out);
+
+    yajl_gen_map_open(g);
+    bench_json_key(g, "trials");
+    yajl_gen_integer(g, opts->trials);
+    bench_json_key(g, "minTrialSecs");
+    yajl_gen_double(g, opts->minTrialSecs);
+    /* for the whole run: it never goes down, so can't be put to any
+     * one benchmark */
+    bench_json_key(g, "peakRssKb");
+    yajl_gen_integer(g, bench_peak_rss_kb());
+    bench_json_key(g, "benchmarks");
+    yajl_gen_array_open(g);
+    for (i = 0; i < count; i++) {
+        const bench_result * r = results + i;
+
+        yajl_gen_map_open(g);
+        bench_json_key(g, "name");
+        bench_json_key(g, r->name);
+        bench_json_key(g, "threads");
+        yajl_gen_integer(g, r->threads);
+        bench_json_key(g, "bytes");
+        yajl_gen_integer(g, (long long) r->work.bytes);
+        bench_json_key(g, "docs");
+        yajl_gen_integer(g, (long long) r->work.docs);
+        bench_json_key(g, "tokens");
+        yajl_gen_integer(g, (long long) r->work.tokens);
+        bench_json_key(g, "bufferedBytes");
+        yajl_gen_integer(g, (long long) r->work.bufferedBytes);
+        bench_json_key(g, "samplesNsPerIter");
+        yajl_gen_array_open(g);
+        for (t = 0; t < r->trials; t++) yajl_gen_double(g, r->samples[t]);
+        yajl_gen_array_close(g);
+        bench_json_summary(g, "nsPerIter", &(r->nsPerIter));
+        bench_json_summary(g, "mbPerSec", &(r->mbPerSec));
+        bench_json_summary(g, "docsPerSec", &(r->docsPerSec));
+        bench_json_summary(g, "nsPerToken", &(r->nsPerToken));
+        if (r->threadMbPerSec) {
+            bench_json_key(g, "threadMbPerSec");
+            yajl_gen_array_open(g);
+            for (t = 0; t < r->threads; t++) {
+                yajl_gen_double(g, r->threadMbPerSec[t]);
+            }
+            yajl_gen_array_close(g);
+        }
+        bench_json_key(g, "counters");
+        yajl_gen_map_open(g);
+        for (t = 0; t < BENCH_NUM_COUNTERS; t++) {
+            if (!r->counters.available[t]) continue;
+            bench_json_key(g, bench_counter_names[t]);
+            yajl_gen_map_open(g);
+            bench_json_key(g, "perIter");
+            yajl_gen_double(g, r->counters.perIter[t]);
+            bench_json_key(g, "perByte");
+            yajl_gen_double(g, r->work.bytes ?
+                            r->counters.perIter[t] / r->work.bytes : 0.0);
+            bench_json_key(g, "perToken");
+            yajl_gen_double(g, r->work.tokens ?
+                            r->counters.perIter[t] / r->work.tokens : 0.0);
+            yajl_gen_map_close(g);
+        }
+        yajl_gen_map_close(g);
+        if (r->memory) {
+            bench_json_key(g, "memory");
+            yajl_gen_map_open(g);
+            bench_json_key(g, "inputBytes");
+            yajl_gen_integer(g, (long long) r->memory->inputBytes);
+            bench_json_key(g, "allocs");
+            yajl_gen_integer(g, (long long) r->memory->allocs);
+            bench_json_key(g, "bytes");
+            yajl_gen_integer(g, (long long) r->memory->bytes);
+            bench_json_key(g, "peakBytes");
+            yajl_gen_integer(g, (long long) r->memory->peakBytes);
+            bench_json_key(g, "peakPerInputByte");
+            yajl_gen_double(g, r->memory->inputBytes ?
+                            (double) r->memory->peakBytes /
+                            r->memory->inputBytes : 0.0);
+            yajl_gen_map_close(g);
+        }
+        if (r->latency) {
+            bench_histogram * h = r->latency;
+            bench_json_key(g, "latencyNs");
+            yajl_gen_map_open(g);
+            bench_json_key(g, "count");
+            yajl_gen_integer(g, (long long) h->total);
+            bench_json_key(g, "mean");
+            yajl_gen_double(g, h->total ? h->sum / h->total : 0.0);
+            bench_json_key(g, "min");
+            yajl_gen_double(g, h->min);
+            bench_json_key(g, "p50");
+            yajl_gen_double(g, bench_hist_percentile(h, 50.0));
+            bench_json_key(g, "p90");
+            yajl_gen_double(g, bench_hist_percentile(h, 90.0));
+            bench_json_key(g, "p99");
+            yajl_gen_double(g, bench_hist_percentile(h, 99.0));
+            bench_json_key(g, "p999");
+            yajl_gen_double(g, bench_hist_percentile(h, 99.9));
+            bench_json_key(g, "max");
+            yajl_gen_double(g, h->max);
+            yajl_gen_map_close(g);
+        }
+        yajl_gen_map_close(g);
+    }
+    yajl_gen_array_close(g);
+    yajl_gen_map_close(g);
+    yajl_gen_free(g);
+
+    rv = ferror(out);
+    if (out != stdout) rv |= fclose(out);
+    return rv != 0;
+}
+
+/* a member of a map in a baseline, or NULL */
+static yajl_val
+bench_json_get(yajl_val v, const char * key, yajl_type type)
+{
+    const char * path[2];
+
+    path[0] = key;
+    path[1] = NULL;
+    return yajl_tree_get(v, path, type);
+}
+
+static yajl_val
+bench_read_baseline(const char * path)
+{
+    FILE * f = fopen(path, "rb");
+    char * text;
+    char errbuf[256];
+    yajl_val v;
+    long size;
+    size_t len;
+
+    if (f == NULL || fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0) {
+        if (f) fclose(f);
+        return NULL;
+    }
+    rewind(f);
+    text = (char *) malloc((size_t) size + 1);
+    len = fread(text, 1, (size_t) size, f);
+    text[len] = 0;
+    fclose(f);
+
+    v = yajl_tree_parse(text, errbuf, sizeof(errbuf));
+    free(text);
+    if (v == NULL) fprintf(stderr, "%s: %s\n", path, errbuf);
+    return v;
+}
+
+/* the baseline's entry for a result, or NULL */
+static yajl_val
+bench_find_baseline(yajl_val benchmarks, const bench_result * r)
+{
+    size_t i;
+
+    for (i = 0; i < benchmarks->u.array.len; i++) {
+        yajl_val b = benchmarks->u.array.values[i];
+        yajl_val name = bench_json_get(b, "name", yajl_t_string);
+        yajl_val threads = bench_json_get(b, "threads", yajl_t_number);
+
+        if (name && threads && !strcmp(name->u.string, r->name) &&
+            YAJL_GET_INTEGER(threads) == (long long) r->threads)
+        {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+int
+bench_compare(FILE * out, const char * path,
+              const bench_result * results, unsigned int count,
+              double threshold)
+{
+    yajl_val baseline = bench_read_baseline(path), benchmarks;
+    unsigned int i;
+    int regressions = 0;
+
+    if (baseline == NULL) return -1;
+    benchmarks = bench_json_get(baseline, "benchmarks", yajl_t_array);
+    if (benchmarks == NULL) {
+        fprintf(stderr, "%s isn't a benchmark results file\n", path);
+        yajl_tree_free(baseline);
+        return -1;
+    }
+
+    fprintf(out, "%-26s %7s %14s %14s %9s  %s\n", "benchmark", "threads",
+            "baseline MB/s", "MB/s", "time", "verdict");
+    for (i = 0; i < count; i++) {
+        const bench_result * r = results + i;
+        yajl_val b = bench_find_baseline(benchmarks, r), samples, bytes, mb;
+        const char * verdict;
+        bench_summary was;
+        double * old;
+        double v1, v2, change;
+        size_t n, j;
+
+        if (b == NULL || r->trials == 0) continue;
+        samples = bench_json_get(b, "samplesNsPerIter", yajl_t_array);
+        bytes = bench_json_get(b, "bytes", yajl_t_number);
+        if (samples == NULL || samples->u.array.len == 0) continue;
+        if (bytes == NULL ||
+            YAJL_GET_INTEGER(bytes) != (long long) r->work.bytes)
+        {
+            fprintf(out, "%-26s %7u  the work differs from the baseline's\n",
+                    r->name, r->threads);
+            continue;
+        }
+
+        n = samples->u.array.len;
+        old = (double *) malloc(n * sizeof(double));
+        for (j = 0; j < n; j++) {
+            yajl_val s = samples->u.array.values[j];
+            old[j] = YAJL_IS_DOUBLE(s) ? YAJL_GET_DOUBLE(s) : 0.0;
+        }
+        bench_summarize(old, (unsigned int) n, &was);
+        free(old);
+        if (was.mean <= 0.0) continue;
+
+        /* Welch's t-test on the time per iteration of each trial, which
+         * doesn't assume both runs were equally noisy */
+        v1 = was.stddev * was.stddev / n;
+        v2 = r->nsPerIter.stddev * r->nsPerIter.stddev / r->trials;
+        change = 100.0 * (r->nsPerIter.mean - was.mean) / was.mean;
+        if (n < 2 || r->trials < 2) {
+            verdict = "too few trials";
+        } else if (v1 + v2 > 0.0 ?
+                   fabs(r->nsPerIter.mean - was.mean) / sqrt(v1 + v2) <
+                   bench_t_critical((v1 + v2) * (v1 + v2) /
+                                    (v1 * v1 / (n - 1) +
+                                     v2 * v2 / (r->trials - 1))) :
+                   change == 0.0)
+        {
+            verdict = "no change";
+        } else if (change > threshold) {
+            verdict = "REGRESSION";
+            regressions++;
+        } else {
+            verdict = change > 0.0 ? "slower" : "faster";
+        }
+
+        mb = bench_json_get(b, "mbPerSec", yajl_t_object);
+        mb = mb ? bench_json_get(mb, "mean", yajl_t_number) : NULL;
+        fprintf(out, "%-26s %7u %14.1f %14.1f %+8.1f%%  %s\n", r->name,
+                r->threads, YAJL_IS_DOUBLE(mb) ? YAJL_GET_DOUBLE(mb) : 0.0,
+                r->mbPerSec.mean, change, verdict);
+    }
+
+    yajl_tree_free(baseline);
+    return regressions;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2007-2011, Lloyd Hilaiel <lloyd@hilaiel.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+/* a small harness which times benchmarks over repeated trials and
+ * reports their throughput with confidence intervals */
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* the work done by one iteration of a benchmark */
+typedef struct {
+    size_t bytes;
+    size_t docs;
+    size_t tokens;
+    /* bytes of tokens the lexer assembled because they crossed chunks */
+    size_t bufferedBytes;
+} bench_work;
+
+/* a benchmark runs one iteration over its input, and counts the work it
+ * did into work when that is non-NULL.  returns zero on success */
+typedef int (*bench_func)(void * ctx, bench_work * work);
+
+typedef struct {
+    /* timed trials per benchmark */
+    unsigned int trials;
+    /* each trial repeats iterations for at least this long */
+    double minTrialSecs;
+} bench_options;
+
+/* the mean of a set of samples, with their standard deviation and the
+ * half width of the 95% confidence interval of the mean */
+typedef struct {
+    double mean;
+    double stddev;
+    double ci;
+} bench_summary;
+
+/* a histogram of latencies in nanoseconds, in the manner of HDR
+ * histograms: buckets are exact below 128ns, and above that each power of
+ * two is split into 64, so any value is within 1.6% */
+typedef struct {
+    size_t * counts;
+    size_t total;
+    double min;
+    double max;
+    double sum;
+} bench_histogram;
+
+void bench_hist_init(bench_histogram * h);
+void bench_hist_free(bench_histogram * h);
+void bench_hist_record(bench_histogram * h, double ns);
+/* the value at or below which p percent of the values lie */
+double bench_hist_percentile(const bench_histogram * h, double p);
+
+/* pin the calling thread to a processor, where the platform allows.
+ * returns zero on success */
+int bench_pin_cpu(unsigned int cpu);
+
+/* hardware performance counters, read around single threaded benchmarks
+ * where the platform allows it (Linux perf_event_open) */
+enum {
+    bench_cycles,
+    bench_instructions,
+    bench_branch_misses,
+    bench_l1d_misses,
+    bench_llc_misses,
+    BENCH_NUM_COUNTERS
+};
+
+extern const char * bench_counter_names[BENCH_NUM_COUNTERS];
+
+typedef struct {
+    int available[BENCH_NUM_COUNTERS];
+    /* counts per iteration of a benchmark */
+    double perIter[BENCH_NUM_COUNTERS];
+} bench_counts;
+
+/* open the counters for the calling thread, to be read by bench_run.
+ * returns the number available, zero if counting isn't permitted */
+int bench_counters_open(void);
+void bench_counters_close(void);
+
+/* the memory an operation allocated, for memory benchmarks */
+typedef struct {
+    size_t inputBytes;
+    /* allocations, counting reallocations */
+    size_t allocs;
+    /* the total of all allocations, and the most live at once */
+    size_t bytes;
+    size_t peakBytes;
+} bench_memory;
+
+/* the process' peak resident set size so far in KB, or zero where the
+ * platform can't tell */
+long bench_peak_rss_kb(void);
+
+typedef struct {
+    const char * name;
+    /* threads running the benchmark at once */
+    unsigned int threads;
+    /* the work done by one iteration */
+    bench_work work;
+    unsigned int trials;
+    /* the mean time of an iteration in each trial */
+    double * samples;
+    /* summaries across trials */
+    bench_summary nsPerIter;
+    bench_summary mbPerSec;
+    bench_summary docsPerSec;
+    bench_summary nsPerToken;
+    /* for threaded benchmarks, each thread's own MB/s over the trials, so
+     * threads that fall behind show up rather than vanish into the total */
+    double * threadMbPerSec;
+    /* hardware counters over the trials, where they were available */
+    bench_counts counters;
+    /* the latency of each operation, for latency benchmarks */
+    bench_histogram * latency;
+    /* what was allocated, for memory benchmarks */
+    bench_memory * memory;
+} bench_result;
+
+/* a monotonic clock, in nanoseconds */
+double bench_now(void);
+
+/* summarize n samples */
+void bench_summarize(const double * samples, unsigned int n,
+                     bench_summary * summary);
+
+/* run a benchmark: one untimed iteration to warm up and count its work,
+ * then the timed trials.  returns zero on success */
+int bench_run(const char * name, bench_func func, void * ctx,
+              const bench_options * opts, bench_result * result);
+
+/* run a benchmark in several threads at once, each with its own context,
+ * which are all warmed up before the trials start together.  the time per
+ * iteration is of the threads together, so rates are their total */
+int bench_run_parallel(const char * name, bench_func func, void ** ctxs,
+                       unsigned int threads, const bench_options * opts,
+                       bench_result * result);
+
+/* the number of processors online */
+unsigned int bench_num_cpus(void);
+
+void bench_result_free(bench_result * result);
+
+/* print results as a table */
+void bench_print_header(FILE * out);
+void bench_print(FILE * out, const bench_result * result);
+
+/* print the hardware counts of results as a table, per byte and token */
+void bench_print_counters_header(FILE * out);
+void bench_print_counters(FILE * out, const bench_result * result);
+
+/* write results as JSON to path, or stdout if path is "-".  returns zero
+ * on success */
+int bench_write_json(const char * path, const bench_options * opts,
+                     const bench_result * results, unsigned int count);
+
+/* compare results with a baseline written by bench_write_json, printing
+ * each timed benchmark found in both with the same threads and work.  a
+ * benchmark has regressed when its time per iteration is longer by more
+ * than threshold percent, and significantly so by Welch's t-test at 95%.
+ * returns the number of regressions, or -1 if the baseline can't be read */
+int bench_compare(FILE * out, const char * path,
+                  const bench_result * results, unsigned int count,
+                  double threshold);
+
+#endif
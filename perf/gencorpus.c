@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2007-2011, Lloyd Hilaiel <lloyd@hilaiel.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/* generate synthetic JSON corpora for perftest and the tools, with
+ * profiles that stress different parts of yajl.  see usage() */
+
+#include <yajl/yajl_gen.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    FILE * out;
+    unsigned long long written;
+    unsigned long long target;
+    /* xorshift64* state */
+    unsigned long long rng;
+} corpus_ctx;
+
+static unsigned long long
+rnd(corpus_ctx * c)
+{
+    c->rng ^= c->rng >> 12;
+    c->rng ^= c->rng << 25;
+    c->rng ^= c->rng >> 27;
+    return c->rng * 2685821657736338717ULL;
+}
+
+/* a random number in [lo, hi] */
+static unsigned int
+rnd_range(corpus_ctx * c, unsigned int lo, unsigned int hi)
+{
+    return lo + (unsigned int) (rnd(c) % (hi - lo + 1));
+}
+
+static void
+corpus_print(void * ctx, const char * str, size_t len)
+{
+    corpus_ctx * c = (corpus_ctx *) ctx;
+    fwrite(str, 1, len, c->out);
+    c->written += len;
+}
+
+static int
+corpus_full(const corpus_ctx * c)
+{
+    return c->written >= c->target;
+}
+
+static yajl_gen
+corpus_gen(corpus_ctx * c)
+{
+    yajl_gen g = yajl_gen_alloc(NULL);
+    yajl_gen_config(g, yajl_gen_print_callback, corpus_print, (void *) c);
+    yajl_gen_config(g, yajl_gen_max_depth, 0u);
+    return g;
+}
+
+static void
+gen_cstr(yajl_gen g, const char * s)
+{
+    yajl_gen_string(g, (const unsigned char *) s, strlen(s));
+}
+
+static void
+gen_key(corpus_ctx * c, yajl_gen g, unsigned int i)
+{
+    char key[32];
+    static const char * names[] = {
+        "id", "name", "value", "type", "created", "tags", "score", "data"
+    };
+    sprintf(key, "%s_%u", names[rnd(c) % 8], i);
+    gen_cstr(g, key);
+}
+
+static void
+gen_number(corpus_ctx * c, yajl_gen g)
+{
+    switch (rnd(c) % 4) {
+        case 0:
+            yajl_gen_integer(g, (long long) rnd_range(c, 0, 1000));
+            break;
+        case 1: {
+            /* each draw in its own statement: the order a single expression
+             * evaluates its operands in varies between compilers */
+            long long mag = (long long) (rnd(c) >> 1);
+            int neg = rnd(c) & 1;
+            yajl_gen_integer(g, neg ? -mag : mag);
+            break;
+        }
+        case 2:
+            yajl_gen_double(g, (double) rnd_range(c, 0, 1000000) / 1000.0);
+            break;
+        default: {
+            char num[64];
+            unsigned int lead = rnd_range(c, 1, 9);
+            unsigned int frac = rnd_range(c, 0, 99999);
+            int neg = rnd(c) & 1;
+            unsigned int power = rnd_range(c, 1, 300);
+            sprintf(num, "%u.%ue%s%u", lead, frac, neg ? "-" : "", power);
+            yajl_gen_number(g, num, strlen(num));
+        }
+    }
+}
+
+/* a string of len bytes: plain ascii, with characters which must be
+ * escaped, or with multibyte utf8 */
+enum { str_ascii, str_escapes, str_utf8 };
+
+static void
+gen_text(corpus_ctx * c, yajl_gen g, size_t len, int kind)
+{
+    static const char * words[] = {
+        "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+        "elit", "sed", "do", "eiusmod", "tempor"
+    };
+    static const char * escapes[] = {
+        "\"", "\\", "/", "\n", "\t", "\r", "\b", "\f", "\001", "\037"
+    };
+    static const char * utf8[] = {
+        "\xc3\xa9", "\xc3\xbc", "\xce\xbb", "\xd0\x96", "\xe2\x82\xac",
+        "\xe6\x97\xa5", "\xe3\x81\x82", "\xf0\x9f\x98\x80", "\xf0\x9d\x84\x9e"
+    };
+    char * s = (char *) malloc(len + 8);
+    size_t used = 0;
+
+    while (used < len) {
+        const char * piece;
+        unsigned int r = (unsigned int) (rnd(c) % 4);
+
+        if (kind == str_escapes && r < 2) piece = escapes[rnd(c) % 10];
+        else if (kind == str_utf8 && r < 2) piece = utf8[rnd(c) % 9];
+        else if (r == 3) piece = " ";
+        else piece = words[rnd(c) % 12];
+
+        if (used + strlen(piece) > len + 4) break;
+        strcpy(s + used, piece);
+        used += strlen(piece);
+    }
+    yajl_gen_string(g, (const unsigned char *) s, used);
+    free(s);
+}
+
+static void
+gen_scalar(corpus_ctx * c, yajl_gen g)
+{
+    switch (rnd(c) % 6) {
+        case 0: yajl_gen_null(g); break;
+        case 1: yajl_gen_bool(g, (int) (rnd(c) & 1)); break;
+        case 2: case 3: gen_number(c, g); break;
+        default: gen_text(c, g, rnd_range(c, 1, 24), str_ascii);
+    }
+}
+
+/* a record as a service might log it */
+static void
+gen_record(corpus_ctx * c, yajl_gen g, unsigned long long id)
+{
+    unsigned int i, n = rnd_range(c, 1, 5);
+
+    yajl_gen_map_open(g);
+    gen_cstr(g, "id");
+    yajl_gen_integer(g, (long long) id);
+    gen_cstr(g, "name");
+    gen_text(c, g, rnd_range(c, 4, 40), str_ascii);
+    gen_cstr(g, "active");
+    yajl_gen_bool(g, (int) (rnd(c) & 1));
+    gen_cstr(g, "score");
+    gen_number(c, g);
+    gen_cstr(g, "tags");
+    yajl_gen_array_open(g);
+    for (i = 0; i < n; i++) gen_text(c, g, rnd_range(c, 3, 12), str_ascii);
+    yajl_gen_array_close(g);
+    gen_cstr(g, "parent");
+    if (rnd(c) & 1) yajl_gen_null(g);
+    else yajl_gen_integer(g, (long long) rnd_range(c, 0, 100000));
+    yajl_gen_map_close(g);
+}
+
+static void
+gen_nested(corpus_ctx * c, yajl_gen g, unsigned int depth)
+{
+    if (depth == 0) {
+        gen_scalar(c, g);
+    } else if (rnd(c) & 1) {
+        yajl_gen_array_open(g);
+        gen_nested(c, g, depth - 1);
+        if (rnd(c) & 1) gen_scalar(c, g);
+        yajl_gen_array_close(g);
+    } else {
+        yajl_gen_map_open(g);
+        gen_key(c, g, depth);
+        gen_nested(c, g, depth - 1);
+        yajl_gen_map_close(g);
+    }
+}
+
+/* the profiles.  each emits one element of a top level array */
+static void
+profile_numbers(corpus_ctx * c, yajl_gen g)
+{
+    gen_number(c, g);
+}
+
+static void
+profile_strings(corpus_ctx * c, yajl_gen g)
+{
+    gen_text(c, g, rnd_range(c, 200, 4000), str_ascii);
+}
+
+static void
+profile_escapes(corpus_ctx * c, yajl_gen g)
+{
+    gen_text(c, g, rnd_range(c, 8, 200), str_escapes);
+}
+
+static void
+profile_utf8(corpus_ctx * c, yajl_gen g)
+{
+    gen_text(c, g, rnd_range(c, 8, 200), str_utf8);
+}
+
+static void
+profile_nested(corpus_ctx * c, yajl_gen g)
+{
+    gen_nested(c, g, rnd_range(c, 16, 1000));
+}
+
+static void
+profile_wide(corpus_ctx * c, yajl_gen g)
+{
+    unsigned int i, n = rnd_range(c, 500, 5000);
+
+    yajl_gen_map_open(g);
+    for (i = 0; i < n && !corpus_full(c); i++) {
+        gen_key(c, g, i);
+        gen_scalar(c, g);
+    }
+    yajl_gen_map_close(g);
+}
+
+static void
+profile_array(corpus_ctx * c, yajl_gen g)
+{
+    gen_scalar(c, g);
+}
+
+static void
+profile_records(corpus_ctx * c, yajl_gen g)
+{
+    gen_record(c, g, rnd(c) % 1000000);
+}
+
+static const struct {
+    const char * name;
+    const char * desc;
+    void (*element)(corpus_ctx * c, yajl_gen g);
+} profiles[] = {
+    { "numbers", "integers and doubles of every form", profile_numbers },
+    { "strings", "long ascii strings", profile_strings },
+    { "escapes", "strings full of characters which must be escaped",
+      profile_escapes },
+    { "utf8", "strings of multibyte utf8", profile_utf8 },
+    { "nested", "arrays and objects nested up to 1000 deep",
+      profile_nested },
+    { "wide", "objects with thousands of keys", profile_wide },
+    { "array", "one huge array of small values", profile_array },
+    { "records", "an array of small records", profile_records },
+    { "ndjson", "newline delimited records", NULL }
+};
+
+#define NUM_PROFILES (sizeof(profiles) / sizeof(profiles[0]))
+
+static void
+generate(corpus_ctx * c, unsigned int p)
+{
+    yajl_gen g;
+
+    if (profiles[p].element == NULL) {
+        /* ndjson: a record to a line, each its own document */
+        unsigned long long id = 0;
+        do {
+            g = corpus_gen(c);
+            gen_record(c, g, id++);
+            yajl_gen_free(g);
+            corpus_print(c, "\n", 1);
+        } while (!corpus_full(c));
+        return;
+    }
+
+    g = corpus_gen(c);
+    yajl_gen_array_open(g);
+    do {
+        profiles[p].element(c, g);
+    } while (!corpus_full(c));
+    yajl_gen_array_close(g);
+    yajl_gen_free(g);
+}
+
+static unsigned long long
+parse_size(const char * s)
+{
+    char * end;
+    unsigned long long size = strtoull(s, &end, 10);
+
+    switch (*end) {
+        case 'k': case 'K': size <<= 10; end++; break;
+        case 'm': case 'M': size <<= 20; end++; break;
+        case 'g': case 'G': size <<= 30; end++; break;
+    }
+    return *end ? 0 : size;
+}
+
+static void
+usage(const char * progname)
+{
+    unsigned int i;
+
+    fprintf(stderr,
+            "usage:  %s -p PROFILE -s SIZE [-r SEED] [-o FILE]\n"
+            "Generate about SIZE bytes (with a k, m or g suffix) of JSON.\n"
+            "The same seed always gives the same output.\n"
+            "\n"
+            "profiles:\n",
+            progname);
+    for (i = 0; i < NUM_PROFILES; i++) {
+        fprintf(stderr, "  %-10s %s\n", profiles[i].name, profiles[i].desc);
+    }
+    exit(1);
+}
+
+int
+main(int argc, char ** argv)
+{
+    corpus_ctx c;
+    const char * profile = NULL, * path = NULL;
+    unsigned int p;
+    int a;
+
+    memset((void *) &c, 0, sizeof(c));
+    c.rng = 1;
+
+    for (a = 1; a < argc; a++) {
+        if (!strcmp(argv[a], "-p") && a + 1 < argc) {
+            profile = argv[++a];
+        } else if (!strcmp(argv[a], "-s") && a + 1 < argc) {
+            c.target = parse_size(argv[++a]);
+            if (c.target == 0) usage(argv[0]);
+        } else if (!strcmp(argv[a], "-r") && a + 1 < argc) {
+            c.rng = strtoull(argv[++a], NULL, 10);
+            /* xorshift never leaves zero */
+            if (c.rng == 0) c.rng = 1;
+        } else if (!strcmp(argv[a], "-o") && a + 1 < argc) {
+            path = argv[++a];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (profile == NULL || c.target == 0) usage(argv[0]);
+
+    for (p = 0; p < NUM_PROFILES; p++) {
+        if (!strcmp(profile, profiles[p].name)) break;
+    }
+    if (p == NUM_PROFILES) usage(argv[0]);
+
+    c.out = path ? fopen(path, "wb") : stdout;
+    if (c.out == NULL) {
+        fprintf(stderr, "couldn't open %s for writing\n", path);
+        return 1;
+    }
+
+    generate(&c, p);
+
+    if (ferror(c.out) || (path && fclose(c.out))) {
+        fprintf(stderr, "error writing output\n");
+        return 1;
+    }
+    return 0;
+}
@@ -14,121 +14,1457 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+
+/* the benchmark suite: times lexing, parsing, tree building, generation,
+ * string encoding and decoding and reformatting over the sample
+ * documents, see usage() */
+
 #include <yajl/yajl_parse.h>
+#include <yajl/yajl_gen.h>
+#include <yajl/yajl_tree.h>
+#include <yajl/yajl_arena.h>
+
+/* the lexer and string routines aren't public, but are in the static
+ * library */
+#include "yajl_lex.h"
+#include "yajl_encode.h"
+#include "yajl_alloc.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "bench.h"
 #include "documents.h"
 
-/* a platform specific defn' of a function to get a high res time in a
- * portable format */
-#ifndef WIN32
-#include <sys/time.h>
-static double mygettime(void) {
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    return now.tv_sec + (now.tv_usec / 1000000.0);
+/* a document of the corpus: its whole text, as yajl_tree_parse takes it,
+ * and the lengths of the chunks it is streamed to the parser in */
+typedef struct {
+    /* what per document results are named for */
+    char * name;
+    char * text;
+    size_t len;
+    size_t * chunkLens;
+    size_t numChunks;
+    size_t tokens;
+    yajl_val tree;
+    /* the document's strings in the corpus' */
+    size_t firstString;
+    size_t numStrings;
+    size_t rawStringBytes;
+    size_t decodedStringBytes;
+} perf_doc;
+
+/* documents loaded from files are streamed in chunks of this size */
+#define PERF_CHUNK_SIZE 4096
+
+/* a string of the corpus, as it appears in the text and decoded */
+typedef struct {
+    const unsigned char * raw;
+    size_t rawLen;
+    unsigned char * decoded;
+    size_t decodedLen;
+} perf_string;
+
+/* how the benchmarks which allocate handles get their memory: a handle
+ * allocated per document from malloc, a handle from a pool of reused
+ * ones, or a handle allocated from an arena cleared after each document */
+typedef enum {
+    perf_alloc_malloc,
+    perf_alloc_pool,
+    perf_alloc_arena
+} perf_alloc_mode;
+
+typedef struct {
+    perf_doc * docs;
+    size_t numDocs;
+    size_t docsAlloc;
+    perf_string * strings;
+    size_t numStrings;
+    size_t stringsAlloc;
+    size_t rawStringBytes;
+    size_t decodedStringBytes;
+    /* scratch state for the benchmarks */
+    yajl_alloc_funcs alloc;
+    yajl_lexer lexer;
+    yajl_buf buf;
+    int validateUTF8;
+    /* the chunk size for the chunked benchmarks, 0 for whole documents */
+    size_t chunkSize;
+    perf_alloc_mode allocMode;
+    /* the pool's handles are bound to poolCallbacks, so it is set up on
+     * first use and set up again when a parse needs other callbacks */
+    yajl_handle_pool pool;
+    const yajl_callbacks * poolCallbacks;
+    yajl_arena arena;
+    yajl_alloc_funcs arenaFuncs;
+} perf_corpus;
+
+/* set up scratch state, for a corpus or a copy of one for a thread */
+static void
+corpus_init_scratch(perf_corpus * c)
+{
+    yajl_set_default_alloc_funcs(&(c->alloc));
+    c->lexer = yajl_lex_alloc(&(c->alloc), 0, 1);
+    c->buf = yajl_buf_alloc(&(c->alloc));
+    c->validateUTF8 = 1;
+    c->pool = NULL;
+    c->poolCallbacks = NULL;
+    c->arena = yajl_arena_alloc(NULL, 0);
+    yajl_arena_get_alloc_funcs(c->arena, &(c->arenaFuncs));
+}
+
+static void
+corpus_free_scratch(perf_corpus * c)
+{
+    yajl_lex_free(c->lexer);
+    yajl_buf_free(c->buf);
+    if (c->pool) yajl_handle_pool_free(c->pool);
+    yajl_arena_free(c->arena);
+}
+
+static void
+corpus_init(perf_corpus * c)
+{
+    memset((void *) c, 0, sizeof(perf_corpus));
+    corpus_init_scratch(c);
 }
-#else
-#define _WIN32 1
-#include <windows.h>
-static double mygettime(void) {
-    long long tval;
-	FILETIME ft;
-	GetSystemTimeAsFileTime(&ft);
-	tval = ft.dwHighDateTime;
-	tval <<=32;
-	tval |= ft.dwLowDateTime;
-	return tval / 10000000.00;
+
+/* add a copy of a document, to be streamed in chunks of PERF_CHUNK_SIZE
+ * unless the caller sets them */
+static perf_doc *
+corpus_add(perf_corpus * c, const char * name, const char * text,
+           size_t len)
+{
+    perf_doc * d;
+    size_t i;
+
+    if (c->numDocs == c->docsAlloc) {
+        c->docsAlloc = c->docsAlloc ? c->docsAlloc * 2 : 16;
+        c->docs = (perf_doc *)
+            realloc(c->docs, c->docsAlloc * sizeof(perf_doc));
+    }
+    d = c->docs + c->numDocs++;
+    memset((void *) d, 0, sizeof(perf_doc));
+    d->name = (char *) malloc(strlen(name) + 1);
+    strcpy(d->name, name);
+    d->text = (char *) malloc(len + 1);
+    memcpy(d->text, text, len);
+    d->text[len] = 0;
+    d->len = len;
+    d->numChunks = (len + PERF_CHUNK_SIZE - 1) / PERF_CHUNK_SIZE;
+    d->chunkLens = (size_t *) malloc((d->numChunks + 1) * sizeof(size_t));
+    for (i = 0; i < d->numChunks; i++) {
+        d->chunkLens[i] = len - i * PERF_CHUNK_SIZE < PERF_CHUNK_SIZE ?
+            len - i * PERF_CHUNK_SIZE : PERF_CHUNK_SIZE;
+    }
+    return d;
 }
-#endif
 
-#define PARSE_TIME_SECS 3
+/* the documents compiled into documents.c, in their own chunks */
+static void
+corpus_add_samples(perf_corpus * c)
+{
+    int i;
+
+    for (i = 0; i < num_docs(); i++) {
+        const char ** p;
+        size_t off = 0;
+        char * text = (char *) malloc(doc_size(i) + 1);
+        char name[32];
+        perf_doc * d;
+
+        for (p = get_doc(i); *p; p++) {
+            memcpy(text + off, *p, strlen(*p));
+            off += strlen(*p);
+        }
+        sprintf(name, "sample%d", i);
+        d = corpus_add(c, name, text, off);
+        free(text);
+
+        for (p = get_doc(i); *p; p++);
+        d->chunkLens = (size_t *)
+            realloc(d->chunkLens, (p - get_doc(i)) * sizeof(size_t));
+        d->numChunks = 0;
+        for (p = get_doc(i); *p; p++) {
+            d->chunkLens[d->numChunks++] = strlen(*p);
+        }
+    }
+}
 
+/* add a file of JSON as a document, or a file of newline delimited JSON
+ * (named *.ndjson) as a document per line.  documents are named for the
+ * file, and the line */
 static int
-run(int validate_utf8)
+corpus_add_file(perf_corpus * c, const char * path)
+{
+    FILE * f = fopen(path, "rb");
+    const char * base = strrchr(path, '/');
+    char * text, * name;
+    size_t len, line = 0, pathLen = strlen(path);
+    long size;
+
+    if (f == NULL || fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0) {
+        fprintf(stderr, "couldn't read %s\n", path);
+        if (f) fclose(f);
+        return 1;
+    }
+    rewind(f);
+    text = (char *) malloc((size_t) size + 1);
+    len = fread(text, 1, (size_t) size, f);
+    fclose(f);
+
+    base = base ? base + 1 : path;
+    name = (char *) malloc(strlen(base) + 32);
+    if (pathLen > 7 && !strcmp(path + pathLen - 7, ".ndjson")) {
+        size_t start = 0, end;
+        for (end = 0; end <= len; end++) {
+            if (end == len || text[end] == '\n') {
+                line++;
+                sprintf(name, "%s:%lu", base, (unsigned long) line);
+                if (end > start) {
+                    corpus_add(c, name, text + start, end - start);
+                }
+                start = end + 1;
+            }
+        }
+    } else {
+        corpus_add(c, base, text, len);
+    }
+    free(name);
+    free(text);
+    return 0;
+}
+
+static void
+add_string(perf_corpus * c, const unsigned char * raw, size_t len)
 {
-    long long times = 0; 
-    double starttime;
+    perf_string * s;
+
+    if (c->numStrings == c->stringsAlloc) {
+        c->stringsAlloc = c->stringsAlloc ? c->stringsAlloc * 2 : 256;
+        c->strings = (perf_string *)
+            realloc(c->strings, c->stringsAlloc * sizeof(perf_string));
+    }
+    s = c->strings + c->numStrings++;
+    s->raw = raw;
+    s->rawLen = len;
+    s->decoded = (unsigned char *) malloc(len + 1);
+    s->decodedLen = yajl_string_decode_raw(s->decoded, raw, len);
+    c->rawStringBytes += s->rawLen;
+    c->decodedStringBytes += s->decodedLen;
+}
 
-    starttime = mygettime();
+/* lex a whole document, counting its tokens and gathering its strings */
+static int
+scan_doc(perf_corpus * c, perf_doc * d)
+{
+    size_t offset = 0, len;
+    const unsigned char * buf;
+    yajl_tok tok;
 
-    /* allocate a parser */
+    yajl_lex_reset(c->lexer, 0, 1);
+    d->firstString = c->numStrings;
     for (;;) {
-		int i;
+        tok = yajl_lex_lex(c->lexer, (const unsigned char *) d->text,
+                           d->len, &offset, &buf, &len);
+        if (tok == yajl_tok_eof) return 0;
+        if (tok == yajl_tok_error) return 1;
+        d->tokens++;
+        if (tok == yajl_tok_string || tok == yajl_tok_string_with_escapes) {
+            add_string(c, buf, len);
+            d->numStrings++;
+            d->rawStringBytes += c->strings[c->numStrings - 1].rawLen;
+            d->decodedStringBytes +=
+                c->strings[c->numStrings - 1].decodedLen;
+        }
+    }
+}
+
+/* build each document's tree and count its tokens and strings */
+static int
+corpus_prepare(perf_corpus * c)
+{
+    size_t i;
+    char errbuf[1024];
+
+    for (i = 0; i < c->numDocs; i++) {
+        perf_doc * d = c->docs + i;
+
+        d->tree = yajl_tree_parse(d->text, errbuf, sizeof(errbuf));
+        if (d->tree == NULL) {
+            fprintf(stderr, "document %lu doesn't parse: %s\n",
+                    (unsigned long) i, errbuf);
+            return 1;
+        }
+        if (scan_doc(c, d)) {
+            fprintf(stderr, "document %lu doesn't lex\n", (unsigned long) i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void
+corpus_free(perf_corpus * c)
+{
+    size_t i;
+
+    for (i = 0; i < c->numDocs; i++) {
+        yajl_tree_free(c->docs[i].tree);
+        free(c->docs[i].name);
+        free(c->docs[i].text);
+        free(c->docs[i].chunkLens);
+    }
+    for (i = 0; i < c->numStrings; i++) free(c->strings[i].decoded);
+    free(c->docs);
+    free(c->strings);
+    corpus_free_scratch(c);
+}
+
+/* narrow the documents and strings the benchmarks run over to one of
+ * whole's documents, or widen them back to all of whole's for the
+ * document count */
+static void
+corpus_narrow(perf_corpus * c, const perf_corpus * whole, size_t doc)
+{
+    if (doc == whole->numDocs) {
+        c->docs = whole->docs;
+        c->numDocs = whole->numDocs;
+        c->strings = whole->strings;
+        c->numStrings = whole->numStrings;
+        c->rawStringBytes = whole->rawStringBytes;
+        c->decodedStringBytes = whole->decodedStringBytes;
+    } else {
+        const perf_doc * d = whole->docs + doc;
+        c->docs = whole->docs + doc;
+        c->numDocs = 1;
+        c->strings = whole->strings + d->firstString;
+        c->numStrings = d->numStrings;
+        c->rawStringBytes = d->rawStringBytes;
+        c->decodedStringBytes = d->decodedStringBytes;
+    }
+}
+
+/* count the work of a pass over every document's text */
+static void
+count_docs(const perf_corpus * c, bench_work * work)
+{
+    size_t i;
+
+    if (work == NULL) return;
+    for (i = 0; i < c->numDocs; i++) {
+        work->bytes += c->docs[i].len;
+        work->tokens += c->docs[i].tokens;
+    }
+    work->docs = c->numDocs;
+}
+
+/* lexing alone, a chunk at a time */
+static int
+bench_lex(void * ctx, bench_work * work)
+{
+    perf_corpus * c = (perf_corpus *) ctx;
+    const unsigned char * buf;
+    size_t len;
+    size_t i, j;
+
+    for (i = 0; i < c->numDocs; i++) {
+        const perf_doc * d = c->docs + i;
+        const char * p = d->text;
+
+        yajl_lex_reset(c->lexer, 0, c->validateUTF8);
+        for (j = 0; j < d->numChunks; p += d->chunkLens[j++]) {
+            size_t offset = 0;
+            yajl_tok tok;
+
+            do {
+                tok = yajl_lex_lex(c->lexer, (const unsigned char *) p,
+                                   d->chunkLens[j], &offset, &buf, &len);
+                if (tok == yajl_tok_error) return 1;
+            } while (tok != yajl_tok_eof);
+        }
+    }
+    count_docs(c, work);
+    return 0;
+}
+
+/* callbacks which consume values the way a client might: summing numbers,
+ * hashing strings and tracking depth */
+typedef struct {
+    unsigned long hash;
+    double sum;
+    unsigned int depth;
+    unsigned int maxDepth;
+} consumer;
+
+static void
+consume_bytes(consumer * c, const unsigned char * s, size_t l)
+{
+    size_t i;
+    for (i = 0; i < l; i++) c->hash = (c->hash ^ s[i]) * 16777619UL;
+}
+
+static int consume_null(void * ctx)
+{
+    ((consumer *) ctx)->hash++;
+    return 1;
+}
+
+static int consume_boolean(void * ctx, int b)
+{
+    ((consumer *) ctx)->hash += b;
+    return 1;
+}
+
+static int consume_integer(void * ctx, long long i)
+{
+    ((consumer *) ctx)->sum += (double) i;
+    return 1;
+}
+
+static int consume_double(void * ctx, double d)
+{
+    ((consumer *) ctx)->sum += d;
+    return 1;
+}
+
+static int consume_string(void * ctx, const unsigned char * s, size_t l)
+{
+    consume_bytes((consumer *) ctx, s, l);
+    return 1;
+}
+
+static int consume_start(void * ctx)
+{
+    consumer * c = (consumer *) ctx;
+    if (++c->depth > c->maxDepth) c->maxDepth = c->depth;
+    return 1;
+}
+
+static int consume_end(void * ctx)
+{
+    ((consumer *) ctx)->depth--;
+    return 1;
+}
+
+static yajl_callbacks consumeCallbacks = {
+    consume_null,
+    consume_boolean,
+    consume_integer,
+    consume_double,
+    NULL,
+    consume_string,
+    consume_start,
+    consume_string,
+    consume_end,
+    consume_start,
+    consume_end
+};
+
+/* parse a document a chunk at a time with a fresh handle, as most
+ * clients do */
+static int
+parse_doc(perf_corpus * c, const perf_doc * d,
+          const yajl_callbacks * callbacks, void * ctx)
+{
+    yajl_handle hand;
+    yajl_status stat = yajl_status_ok;
+    const char * p = d->text;
+    size_t j;
+
+    if (c->allocMode == perf_alloc_pool) {
+        if (c->pool == NULL || c->poolCallbacks != callbacks) {
+            if (c->pool) yajl_handle_pool_free(c->pool);
+            c->pool = yajl_handle_pool_alloc(callbacks, NULL, 4);
+            c->poolCallbacks = callbacks;
+        }
+        hand = yajl_handle_pool_get(c->pool, ctx);
+    } else {
+        hand = yajl_alloc(callbacks, c->allocMode == perf_alloc_arena ?
+                          &(c->arenaFuncs) : NULL, ctx);
+    }
+
+    yajl_config(hand, yajl_dont_validate_strings, !c->validateUTF8);
+    for (j = 0; j < d->numChunks && stat == yajl_status_ok; j++) {
+        stat = yajl_parse(hand, (const unsigned char *) p, d->chunkLens[j]);
+        p += d->chunkLens[j];
+    }
+    if (stat == yajl_status_ok) stat = yajl_complete_parse(hand);
+
+    if (c->allocMode == perf_alloc_pool) {
+        yajl_handle_pool_put(c->pool, hand);
+    } else {
+        yajl_free(hand);
+        if (c->allocMode == perf_alloc_arena) yajl_arena_clear(c->arena);
+    }
+    return stat != yajl_status_ok;
+}
+
+static int
+bench_parse(void * ctx, bench_work * work)
+{
+    perf_corpus * c = (perf_corpus *) ctx;
+    consumer consume;
+    size_t i;
+
+    memset((void *) &consume, 0, sizeof(consume));
+    for (i = 0; i < c->numDocs; i++) {
+        if (parse_doc(c, c->docs + i, &consumeCallbacks, &consume)) {
+            return 1;
+        }
+    }
+    count_docs(c, work);
+    return 0;
+}
+
+static int
+bench_parse_novalidate(void * ctx, bench_work * work)
+{
+    perf_corpus * c = (perf_corpus *) ctx;
+    int rv;
+
+    c->validateUTF8 = 0;
+    rv = bench_parse(ctx, work);
+    c->validateUTF8 = 1;
+    return rv;
+}
+
+/* parse each document's whole text in chunks of chunkSize bytes, which
+ * for most sizes leaves tokens straddling the boundaries */
+static int
+bench_chunked(void * ctx, bench_work * work)
+{
+    perf_corpus * c = (perf_corpus *) ctx;
+    consumer consume;
+    size_t i;
+
+    memset((void *) &consume, 0, sizeof(consume));
+    for (i = 0; i < c->numDocs; i++) {
+        const perf_doc * d = c->docs + i;
+        size_t off, size = c->chunkSize ? c->chunkSize : d->len;
+        yajl_handle hand = yajl_alloc(&consumeCallbacks, NULL, &consume);
+        yajl_status stat = yajl_status_ok;
+
+        for (off = 0; off < d->len && stat == yajl_status_ok; off += size) {
+            stat = yajl_parse(hand, (const unsigned char *) d->text + off,
+                              d->len - off < size ? d->len - off : size);
+        }
+        if (stat == yajl_status_ok) stat = yajl_complete_parse(hand);
+        if (work) {
+            yajl_stats stats;
+            yajl_get_stats(hand, &stats);
+            work->bufferedBytes += stats.bufferedBytes;
+        }
+        yajl_free(hand);
+        if (stat != yajl_status_ok) return 1;
+    }
+    count_docs(c, work);
+    return 0;
+}
+
+static int
+bench_tree(void * ctx, bench_work * work)
+{
+    perf_corpus * c = (perf_corpus *) ctx;
+    size_t i;
+
+    for (i = 0; i < c->numDocs; i++) {
+        yajl_val tree;
+
+        if (c->allocMode == perf_alloc_arena) {
+            tree = yajl_tree_parse_alloc(c->docs[i].text, &(c->arenaFuncs),
+                                         NULL, 0);
+            if (tree == NULL) return 1;
+            yajl_arena_clear(c->arena);
+        } else {
+            tree = yajl_tree_parse(c->docs[i].text, NULL, 0);
+            if (tree == NULL) return 1;
+            yajl_tree_free(tree);
+        }
+    }
+    count_docs(c, work);
+    return 0;
+}
+
+/* generate a value from a tree, counting the tokens generated */
+static size_t
+gen_value(yajl_gen g, yajl_val v)
+{
+    size_t i, tokens = 1;
+
+    switch (v->type) {
+        case yajl_t_string:
+            yajl_gen_string(g, (const unsigned char *) v->u.string,
+                            strlen(v->u.string));
+            break;
+        case yajl_t_number:
+            if (YAJL_IS_INTEGER(v)) yajl_gen_integer(g, YAJL_GET_INTEGER(v));
+            else yajl_gen_double(g, YAJL_GET_DOUBLE(v));
+            break;
+        case yajl_t_object:
+            yajl_gen_map_open(g);
+            for (i = 0; i < v->u.object.len; i++) {
+                const char * key = v->u.object.keys[i];
+                yajl_gen_string(g, (const unsigned char *) key, strlen(key));
+                tokens += 1 + gen_value(g, v->u.object.values[i]);
+            }
+            yajl_gen_map_close(g);
+            tokens++;
+            break;
+        case yajl_t_array:
+            yajl_gen_array_open(g);
+            for (i = 0; i < v->u.array.len; i++) {
+                tokens += gen_value(g, v->u.array.values[i]);
+            }
+            yajl_gen_array_close(g);
+            tokens++;
+            break;
+        case yajl_t_true:
+            yajl_gen_bool(g, 1);
+            break;
+        case yajl_t_false:
+            yajl_gen_bool(g, 0);
+            break;
+        default:
+            yajl_gen_null(g);
+            break;
+    }
+    return tokens;
+}
+
+static int
+run_gen(perf_corpus * c, bench_work * work, int beautify)
+{
+    size_t i;
+
+    for (i = 0; i < c->numDocs; i++) {
+        yajl_gen g = yajl_gen_alloc(c->allocMode == perf_alloc_arena ?
+                                    &(c->arenaFuncs) : NULL);
+        const unsigned char * buf;
+        size_t len, tokens;
+
+        yajl_gen_config(g, yajl_gen_beautify, beautify);
+        tokens = gen_value(g, c->docs[i].tree);
+        if (yajl_gen_get_buf(g, &buf, &len) != yajl_gen_status_ok) {
+            yajl_gen_free(g);
+            return 1;
+        }
+        if (work) {
+            work->bytes += len;
+            work->tokens += tokens;
+            work->docs++;
+        }
+        yajl_gen_free(g);
+        if (c->allocMode == perf_alloc_arena) yajl_arena_clear(c->arena);
+    }
+    return 0;
+}
+
+static int
+bench_gen(void * ctx, bench_work * work)
+{
+    return run_gen((perf_corpus *) ctx, work, 0);
+}
+
+static int
+bench_gen_beautify(void * ctx, bench_work * work)
+{
+    return run_gen((perf_corpus *) ctx, work, 1);
+}
+
+static void
+count_strings(const perf_corpus * c, bench_work * work, size_t bytes)
+{
+    if (work == NULL) return;
+    work->bytes = bytes;
+    work->tokens = c->numStrings;
+    work->docs = c->numDocs;
+}
+
+static int
+bench_decode(void * ctx, bench_work * work)
+{
+    perf_corpus * c = (perf_corpus *) ctx;
+    size_t i;
+
+    for (i = 0; i < c->numStrings; i++) {
+        yajl_buf_clear(c->buf);
+        yajl_string_decode(c->buf, c->strings[i].raw, c->strings[i].rawLen);
+    }
+    count_strings(c, work, c->rawStringBytes);
+    return 0;
+}
+
+static void
+buf_print(void * ctx, const char * str, size_t len)
+{
+    yajl_buf_append((yajl_buf) ctx, str, len);
+}
+
+static int
+bench_encode(void * ctx, bench_work * work)
+{
+    perf_corpus * c = (perf_corpus *) ctx;
+    size_t i;
+
+    for (i = 0; i < c->numStrings; i++) {
+        yajl_buf_clear(c->buf);
+        yajl_string_encode(buf_print, c->buf, c->strings[i].decoded,
+                           c->strings[i].decodedLen, 0);
+    }
+    count_strings(c, work, c->decodedStringBytes);
+    return 0;
+}
+
+/* callbacks which regenerate what is parsed, as json_reformat does */
+static int reformat_null(void * ctx)
+{
+    return yajl_gen_null((yajl_gen) ctx) == yajl_gen_status_ok;
+}
+
+static int reformat_boolean(void * ctx, int b)
+{
+    return yajl_gen_bool((yajl_gen) ctx, b) == yajl_gen_status_ok;
+}
+
+static int reformat_number(void * ctx, const char * s, size_t l)
+{
+    return yajl_gen_number((yajl_gen) ctx, s, l) == yajl_gen_status_ok;
+}
+
+static int reformat_string(void * ctx, const unsigned char * s, size_t l)
+{
+    return yajl_gen_string((yajl_gen) ctx, s, l) == yajl_gen_status_ok;
+}
+
+static int reformat_start_map(void * ctx)
+{
+    return yajl_gen_map_open((yajl_gen) ctx) == yajl_gen_status_ok;
+}
+
+static int reformat_end_map(void * ctx)
+{
+    return yajl_gen_map_close((yajl_gen) ctx) == yajl_gen_status_ok;
+}
+
+static int reformat_start_array(void * ctx)
+{
+    return yajl_gen_array_open((yajl_gen) ctx) == yajl_gen_status_ok;
+}
+
+static int reformat_end_array(void * ctx)
+{
+    return yajl_gen_array_close((yajl_gen) ctx) == yajl_gen_status_ok;
+}
+
+static yajl_callbacks reformatCallbacks = {
+    reformat_null,
+    reformat_boolean,
+    NULL,
+    NULL,
+    reformat_number,
+    reformat_string,
+    reformat_start_map,
+    reformat_string,
+    reformat_end_map,
+    reformat_start_array,
+    reformat_end_array
+};
+
+static int
+bench_reformat(void * ctx, bench_work * work)
+{
+    perf_corpus * c = (perf_corpus *) ctx;
+    size_t i;
+
+    for (i = 0; i < c->numDocs; i++) {
+        yajl_gen g = yajl_gen_alloc(NULL);
+        int rv = parse_doc(c, c->docs + i, &reformatCallbacks, g);
+        yajl_gen_free(g);
+        if (rv) return 1;
+    }
+    count_docs(c, work);
+    return 0;
+}
+
+/* minifying by copying tokens through from the parser, as json_reformat
+ * -m does */
+static int
+bench_minify(void * ctx, bench_work * work)
+{
+    perf_corpus * c = (perf_corpus *) ctx;
+    size_t i, j;
+
+    for (i = 0; i < c->numDocs; i++) {
+        const perf_doc * d = c->docs + i;
+        yajl_handle hand = yajl_alloc(NULL, NULL, NULL);
+        yajl_status stat = yajl_status_ok;
+        const char * p = d->text;
+
+        yajl_config(hand, yajl_minify, buf_print, (void *) c->buf);
+        yajl_buf_clear(c->buf);
+        for (j = 0; j < d->numChunks && stat == yajl_status_ok; j++) {
+            stat = yajl_parse(hand, (const unsigned char *) p,
+                              d->chunkLens[j]);
+            p += d->chunkLens[j];
+        }
+        if (stat == yajl_status_ok) stat = yajl_complete_parse(hand);
+        yajl_free(hand);
+        if (stat != yajl_status_ok) return 1;
+    }
+    count_docs(c, work);
+    return 0;
+}
+
+static const struct {
+    const char * name;
+    bench_func func;
+    /* the chunk size, for bench_chunked */
+    size_t chunkSize;
+} benchmarks[] = {
+    { "lex", bench_lex, 0 },
+    { "parse", bench_parse, 0 },
+    { "parse_novalidate", bench_parse_novalidate, 0 },
+    { "tree", bench_tree, 0 },
+    { "gen", bench_gen, 0 },
+    { "gen_beautify", bench_gen_beautify, 0 },
+    { "string_decode", bench_decode, 0 },
+    { "string_encode", bench_encode, 0 },
+    { "reformat", bench_reformat, 0 },
+    { "minify", bench_minify, 0 },
+    { "chunk_1", bench_chunked, 1 },
+    { "chunk_3", bench_chunked, 3 },
+    { "chunk_16", bench_chunked, 16 },
+    { "chunk_100", bench_chunked, 100 },
+    { "chunk_1000", bench_chunked, 1000 },
+    { "chunk_4096", bench_chunked, 4096 },
+    { "chunk_65536", bench_chunked, 65536 },
+    { "chunk_whole", bench_chunked, 0 }
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/* the workloads of the scaling mode, under each allocation strategy */
+static const struct {
+    const char * name;
+    bench_func func;
+    perf_alloc_mode allocMode;
+} scalings[] = {
+    { "parse.malloc", bench_parse, perf_alloc_malloc },
+    { "parse.pool", bench_parse, perf_alloc_pool },
+    { "parse.arena", bench_parse, perf_alloc_arena },
+    { "tree.malloc", bench_tree, perf_alloc_malloc },
+    { "tree.arena", bench_tree, perf_alloc_arena },
+    { "gen.malloc", bench_gen, perf_alloc_malloc },
+    { "gen.arena", bench_gen, perf_alloc_arena }
+};
+
+#define NUM_SCALINGS (sizeof(scalings) / sizeof(scalings[0]))
+
+static void
+usage(const char * progname)
+{
+    unsigned int i;
+
+    fprintf(stderr,
+            "usage:  %s [options] [benchmark ...]\n"
+            "Time yajl over the sample documents, or those in files given\n"
+            "with -c, running every benchmark unless some are named.\n"
+            "\n"
+            "  -c FILE  load a document from FILE, or a document per line\n"
+            "           if it is named *.ndjson.  may be repeated\n"
+            "  -t N     run N timed trials of each benchmark (default 10)\n"
+            "  -s SECS  make each trial last at least SECS seconds\n"
+            "           (default 0.2)\n"
+            "  -o FILE  write results as JSON to FILE, - for stdout\n"
+            "  -T N     measure scaling instead: run the threaded workloads\n"
+            "           in 1, 2, 4... up to N threads, 0 for one per\n"
+            "           processor\n"
+            "  -M       report what parsing, tree parsing and generating\n"
+            "           allocate on each document instead\n"
+            "  -D       run each benchmark on each document as well as on\n"
+            "           them all, for results per document\n"
+            "  -b FILE  compare the results with a baseline written by -o,\n"
+            "           exiting with status 2 if any regressed\n"
+            "  -r PCT   call a significant slowdown of more than PCT\n"
+            "           percent a regression (default 5)\n"
+            "  -n       don't read hardware performance counters\n"
+            "  -L       measure the latency of single operations on small\n"
+            "           messages instead, with a trial's length of warm up\n"
+            "           then timing for the length of all the trials\n"
+            "\n"
+            "benchmarks:",
+            progname);
+    for (i = 0; i < NUM_BENCHMARKS; i++) {
+        fprintf(stderr, " %s", benchmarks[i].name);
+    }
+    fprintf(stderr, "\n\nthreaded workloads:");
+    for (i = 0; i < NUM_SCALINGS; i++) {
+        fprintf(stderr, " %s", scalings[i].name);
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static void
+print_scaling_header(FILE * out)
+{
+    fprintf(out, "%-14s %7s %20s %12s %16s %8s\n", "workload", "threads",
+            "total MB/s", "MB/s/thread", "thread min-max", "scaling");
+}
+
+/* print a result with its scaling relative to one thread */
+static void
+print_scaling(FILE * out, const bench_result * r, const bench_result * one)
+{
+    char total[32], spread[32];
+    double lo = r->mbPerSec.mean, hi = r->mbPerSec.mean;
+    unsigned int i;
+
+    /* what each thread managed on its own, which the mean can hide */
+    if (r->threadMbPerSec) {
+        lo = hi = r->threadMbPerSec[0];
+        for (i = 1; i < r->threads; i++) {
+            if (r->threadMbPerSec[i] < lo) lo = r->threadMbPerSec[i];
+            if (r->threadMbPerSec[i] > hi) hi = r->threadMbPerSec[i];
+        }
+    }
+    sprintf(total, "%.1f +- %.1f", r->mbPerSec.mean, r->mbPerSec.ci);
+    sprintf(spread, "%.1f-%.1f", lo, hi);
+    fprintf(out, "%-14s %7u %20s %12.1f %16s %7.0f%%\n", r->name,
+            r->threads, total, r->mbPerSec.mean / r->threads, spread,
+            100.0 * r->mbPerSec.mean / (r->threads * one->mbPerSec.mean));
+}
+
+/* run the selected threaded workloads at each thread count, each thread
+ * with its own copy of the corpus' scratch state */
+static int
+run_scaling(perf_corpus * corpus, const bench_options * opts,
+            unsigned int maxThreads, const int * selected, int anySelected,
+            FILE * out, bench_result * results, unsigned int * count)
+{
+    perf_corpus * copies = (perf_corpus *)
+        malloc(maxThreads * sizeof(perf_corpus));
+    void ** ctxs = (void **) malloc(maxThreads * sizeof(void *));
+    unsigned int i, t, threads;
+    int rv = 0;
+
+    for (t = 0; t < maxThreads; t++) {
+        memcpy((void *) (copies + t), (void *) corpus, sizeof(perf_corpus));
+        corpus_init_scratch(copies + t);
+        ctxs[t] = copies + t;
+    }
+
+    print_scaling_header(out);
+    for (i = 0; i < NUM_SCALINGS && rv == 0; i++) {
+        unsigned int first = *count;
+
+        if (anySelected && !selected[i]) continue;
+        for (t = 0; t < maxThreads; t++) {
+            copies[t].allocMode = scalings[i].allocMode;
+        }
+        /* every power of two up to maxThreads, then maxThreads */
+        for (threads = 1; threads <= maxThreads;
+             threads = (threads < maxThreads && threads * 2 > maxThreads) ?
+                       maxThreads : threads * 2)
         {
-            double now = mygettime();
-            if (now - starttime >= PARSE_TIME_SECS) break;
+            if (bench_run_parallel(scalings[i].name, scalings[i].func, ctxs,
+                                   threads, opts, results + *count))
+            {
+                fprintf(stderr, "workload %s failed with %u threads\n",
+                        scalings[i].name, threads);
+                rv = 1;
+                break;
+            }
+            print_scaling(out, results + *count, results + first);
+            (*count)++;
+            if (threads == maxThreads) break;
         }
+    }
 
-        for (i = 0; i < 100; i++) {
-            yajl_handle hand = yajl_alloc(NULL, NULL, NULL);
-            yajl_status stat;        
-            const char ** d;
+    for (t = 0; t < maxThreads; t++) corpus_free_scratch(copies + t);
+    free(copies);
+    free(ctxs);
+    return rv;
+}
+
+/* run the selected benchmarks over the corpus and, with perDoc, over
+ * each of its documents alone, those results named in names which the
+ * caller frees */
+static int
+run_benchmarks(perf_corpus * corpus, const bench_options * opts,
+               const int * selected, int anySelected, int perDoc, FILE * out,
+               bench_result * results, unsigned int * count, char ** names)
+{
+    perf_corpus whole;
+    size_t k, numRuns = perDoc ? corpus->numDocs + 1 : 1;
+    unsigned int i;
+    int rv = 0;
 
-            yajl_config(hand, yajl_dont_validate_strings, validate_utf8 ? 0 : 1);
+    memcpy((void *) &whole, (void *) corpus, sizeof(perf_corpus));
+    bench_print_header(out);
+    for (i = 0; i < NUM_BENCHMARKS && rv == 0; i++) {
+        if (anySelected && !selected[i]) continue;
+        corpus->chunkSize = benchmarks[i].chunkSize;
+        /* all the documents, then each alone */
+        for (k = 0; k < numRuns; k++) {
+            size_t doc = k ? k - 1 : whole.numDocs;
+            const char * name = benchmarks[i].name;
 
-            for (d = get_doc(times % num_docs()); *d; d++) {
-                stat = yajl_parse(hand, (unsigned char *) *d, strlen(*d));
-                if (stat != yajl_status_ok) break;
+            if (k) {
+                *names = (char *) malloc(strlen(name) +
+                                         strlen(whole.docs[doc].name) + 2);
+                sprintf(*names, "%s/%s", name, whole.docs[doc].name);
+                name = *names++;
             }
-            
-            stat = yajl_complete_parse(hand);
-
-            if (stat != yajl_status_ok) {
-                unsigned char * str =
-                    yajl_get_error(hand, 1,
-                                   (unsigned char *) *d,
-                                   (*d ? strlen(*d) : 0));
-                fprintf(stderr, "%s", (const char *) str);
-                yajl_free_error(hand, str);
-                return 1;
+            corpus_narrow(corpus, &whole, doc);
+            if (bench_run(name, benchmarks[i].func, corpus, opts,
+                          results + *count))
+            {
+                fprintf(stderr, "benchmark %s failed\n", name);
+                rv = 1;
+                break;
             }
-            yajl_free(hand);
-            times++;
+            bench_print(out, results + *count);
+            (*count)++;
         }
     }
+    corpus_narrow(corpus, &whole, whole.numDocs);
+    return rv;
+}
 
-    /* parsed doc 'times' times */
-    {
-        double throughput;
-        double now;
-        const char * all_units[] = { "B/s", "KB/s", "MB/s", (char *) 0 };
-        const char ** units = all_units;
-        int i, avg_doc_size = 0;
+/* messages for the latency benchmarks: documents, and maps and arrays
+ * within them, whose minified text is PERF_MSG_MIN to PERF_MSG_MAX bytes,
+ * as an RPC layer might see them */
+#define PERF_MSG_MIN 200
+#define PERF_MSG_MAX 4096
+#define PERF_MSG_COUNT 1000
+
+typedef struct {
+    char * text;
+    size_t len;
+    /* the value in its document's tree */
+    yajl_val tree;
+} perf_msg;
 
-        now = mygettime();
+typedef struct {
+    perf_msg * msgs;
+    size_t count;
+} perf_msgs;
 
-        for (i = 0; i < num_docs(); i++) avg_doc_size += doc_size(i);
-        avg_doc_size /= num_docs();
+static void
+collect_messages(perf_msgs * m, yajl_val v)
+{
+    yajl_gen g;
+    const unsigned char * buf;
+    size_t i, len;
 
-        throughput = (times * avg_doc_size) / (now - starttime);
-        
-        while (*(units + 1) && throughput > 1024) {
-            throughput /= 1024;
-            units++;
+    if (m->count == PERF_MSG_COUNT) return;
+    if (!YAJL_IS_OBJECT(v) && !YAJL_IS_ARRAY(v)) return;
+
+    g = yajl_gen_alloc(NULL);
+    gen_value(g, v);
+    yajl_gen_get_buf(g, &buf, &len);
+    if (len >= PERF_MSG_MIN && len <= PERF_MSG_MAX) {
+        perf_msg * msg = m->msgs + m->count++;
+        msg->text = (char *) malloc(len + 1);
+        memcpy(msg->text, buf, len);
+        msg->text[len] = 0;
+        msg->len = len;
+        msg->tree = v;
+    }
+    yajl_gen_free(g);
+
+    if (YAJL_IS_OBJECT(v)) {
+        for (i = 0; i < v->u.object.len; i++) {
+            collect_messages(m, v->u.object.values[i]);
+        }
+    } else {
+        for (i = 0; i < v->u.array.len; i++) {
+            collect_messages(m, v->u.array.values[i]);
         }
-        
-        printf("Parsing speed: %g %s\n", throughput, *units);
     }
+}
 
+static int
+latency_parse(const perf_msg * msg)
+{
+    consumer consume;
+    yajl_handle hand = yajl_alloc(&consumeCallbacks, NULL, &consume);
+    yajl_status stat;
+
+    memset((void *) &consume, 0, sizeof(consume));
+    stat = yajl_parse(hand, (const unsigned char *) msg->text, msg->len);
+    if (stat == yajl_status_ok) stat = yajl_complete_parse(hand);
+    yajl_free(hand);
+    return stat != yajl_status_ok;
+}
+
+static int
+latency_tree(const perf_msg * msg)
+{
+    yajl_val tree = yajl_tree_parse(msg->text, NULL, 0);
+    if (tree == NULL) return 1;
+    yajl_tree_free(tree);
     return 0;
 }
 
-int
-main(void)
+static int
+latency_gen(const perf_msg * msg)
+{
+    yajl_gen g = yajl_gen_alloc(NULL);
+    const unsigned char * buf;
+    size_t len;
+    int rv;
+
+    gen_value(g, msg->tree);
+    rv = yajl_gen_get_buf(g, &buf, &len) != yajl_gen_status_ok;
+    yajl_gen_free(g);
+    return rv;
+}
+
+/* the latency benchmarks: each operation includes allocating and freeing
+ * its handle */
+static const struct {
+    const char * name;
+    int (*op)(const perf_msg * msg);
+} latencies[] = {
+    { "latency.parse", latency_parse },
+    { "latency.tree", latency_tree },
+    { "latency.gen", latency_gen }
+};
+
+#define NUM_LATENCIES (sizeof(latencies) / sizeof(latencies[0]))
+
+static void
+print_latency_header(FILE * out)
+{
+    fprintf(out, "%-14s %9s %9s %9s %9s %9s %9s %9s\n", "op (us)", "ops",
+            "mean", "p50", "p90", "p99", "p99.9", "max");
+}
+
+static void
+print_latency(FILE * out, const bench_result * r)
+{
+    const bench_histogram * h = r->latency;
+
+    fprintf(out, "%-14s %9lu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+            r->name, (unsigned long) h->total, h->sum / h->total / 1e3,
+            bench_hist_percentile(h, 50.0) / 1e3,
+            bench_hist_percentile(h, 90.0) / 1e3,
+            bench_hist_percentile(h, 99.0) / 1e3,
+            bench_hist_percentile(h, 99.9) / 1e3, h->max / 1e3);
+}
+
+/* time every operation on the messages, one after another, pinned to the
+ * first processor.  each runs untimed for a trial's length to warm up,
+ * then timed for the length of all the trials */
+static int
+run_latency(perf_corpus * corpus, const bench_options * opts, FILE * out,
+            bench_result * results, unsigned int * count)
 {
+    perf_msgs m;
+    size_t i, j;
     int rv = 0;
 
-    printf("-- speed tests determine parsing throughput given %d different sample documents --\n",
-           num_docs());
+    m.msgs = (perf_msg *) calloc(PERF_MSG_COUNT, sizeof(perf_msg));
+    m.count = 0;
+    for (i = 0; i < corpus->numDocs; i++) {
+        collect_messages(&m, corpus->docs[i].tree);
+    }
+    if (m.count == 0) {
+        fprintf(stderr, "no messages of %d to %d bytes in the corpus\n",
+                PERF_MSG_MIN, PERF_MSG_MAX);
+        free(m.msgs);
+        return 1;
+    }
+
+    if (bench_pin_cpu(0)) {
+        fprintf(stderr, "couldn't pin to a processor, latencies may be "
+                "noisier\n");
+    }
+    fprintf(out, "-- %lu messages of %d to %d bytes --\n",
+            (unsigned long) m.count, PERF_MSG_MIN, PERF_MSG_MAX);
+    print_latency_header(out);
+
+    for (i = 0; i < NUM_LATENCIES && rv == 0; i++) {
+        bench_result * r = results + (*count);
+        double start, end;
+
+        memset((void *) r, 0, sizeof(bench_result));
+        r->name = latencies[i].name;
+        r->threads = 1;
+        r->latency = (bench_histogram *) malloc(sizeof(bench_histogram));
+        bench_hist_init(r->latency);
+        for (j = 0; j < m.count; j++) r->work.bytes += m.msgs[j].len;
+        r->work.docs = m.count;
+        (*count)++;
+
+        start = bench_now();
+        for (j = 0; bench_now() - start < opts->minTrialSecs * 1e9; j++) {
+            if (latencies[i].op(m.msgs + j % m.count)) rv = 1;
+        }
+
+        end = bench_now() + opts->trials * opts->minTrialSecs * 1e9;
+        for (j = 0; rv == 0; j++) {
+            double before = bench_now(), after;
+            rv = latencies[i].op(m.msgs + j % m.count);
+            after = bench_now();
+            bench_hist_record(r->latency, after - before);
+            if (after >= end) break;
+        }
+
+        if (rv) fprintf(stderr, "%s failed\n", latencies[i].name);
+        else print_latency(out, r);
+    }
+
+    for (i = 0; i < m.count; i++) free(m.msgs[i].text);
+    free(m.msgs);
+    return rv;
+}
+
+/* the operations of the memory benchmarks, on a document with the
+ * allocation functions of a yajl_mem_tracker */
+static int
+memory_parse(perf_corpus * c, const perf_doc * d, yajl_alloc_funcs * afs)
+{
+    consumer consume;
+    yajl_handle hand = yajl_alloc(&consumeCallbacks, afs, &consume);
+    yajl_status stat = yajl_status_ok;
+    const char * p = d->text;
+    size_t j;
+
+    memset((void *) &consume, 0, sizeof(consume));
+    for (j = 0; j < d->numChunks && stat == yajl_status_ok; j++) {
+        stat = yajl_parse(hand, (const unsigned char *) p, d->chunkLens[j]);
+        p += d->chunkLens[j];
+    }
+    if (stat == yajl_status_ok) stat = yajl_complete_parse(hand);
+    yajl_free(hand);
+    return stat != yajl_status_ok;
+}
+
+static int
+memory_tree(perf_corpus * c, const perf_doc * d, yajl_alloc_funcs * afs)
+{
+    yajl_val tree = yajl_tree_parse_alloc(d->text, afs, NULL, 0);
+    if (tree == NULL) return 1;
+    yajl_tree_free_alloc(tree, afs);
+    return 0;
+}
+
+static int
+memory_gen(perf_corpus * c, const perf_doc * d, yajl_alloc_funcs * afs)
+{
+    yajl_gen g = yajl_gen_alloc(afs);
+    const unsigned char * buf;
+    size_t len;
+    int rv;
 
-    printf("With UTF8 validation:\n");
-    rv = run(1);
-    if (rv != 0) return rv;
-    printf("Without UTF8 validation:\n");
-    rv = run(0);
+    gen_value(g, d->tree);
+    rv = yajl_gen_get_buf(g, &buf, &len) != yajl_gen_status_ok;
+    yajl_gen_free(g);
     return rv;
 }
 
+static const struct {
+    const char * name;
+    int (*op)(perf_corpus * c, const perf_doc * d, yajl_alloc_funcs * afs);
+} memories[] = {
+    { "parse", memory_parse },
+    { "tree", memory_tree },
+    { "gen", memory_gen }
+};
+
+#define NUM_MEMORIES (sizeof(memories) / sizeof(memories[0]))
+
+/* count what each operation allocates on each document.  results are
+ * named for both, in names, which the caller frees */
+static int
+run_memory(perf_corpus * corpus, FILE * out, bench_result * results,
+           unsigned int * count, char ** names)
+{
+    size_t i;
+    unsigned int k;
+
+    fprintf(out, "%-6s %-6s %10s %8s %12s %10s %10s\n", "doc", "op",
+            "input", "allocs", "allocated", "peak", "peak/in");
+    for (i = 0; i < corpus->numDocs; i++) {
+        const perf_doc * d = corpus->docs + i;
+
+        for (k = 0; k < NUM_MEMORIES; k++) {
+            yajl_mem_tracker tracker;
+            bench_result * r = results + (*count);
+            bench_memory * m;
+
+            yajl_mem_tracker_init(&tracker, NULL);
+            if (memories[k].op(corpus, d, &tracker.funcs)) {
+                fprintf(stderr, "%s failed on document %lu\n",
+                        memories[k].name, (unsigned long) i);
+                return 1;
+            }
+
+            memset((void *) r, 0, sizeof(bench_result));
+            *names = (char *) malloc(64);
+            sprintf(*names, "memory.%s.%lu", memories[k].name,
+                    (unsigned long) i);
+            r->name = *names++;
+            r->threads = 1;
+            r->work.bytes = d->len;
+            r->work.docs = 1;
+            r->work.tokens = d->tokens;
+            r->memory = m = (bench_memory *) malloc(sizeof(bench_memory));
+            m->inputBytes = d->len;
+            m->allocs = tracker.stats.allocs + tracker.stats.reallocs;
+            m->bytes = tracker.stats.totalBytes;
+            m->peakBytes = tracker.stats.peakBytes;
+            (*count)++;
+
+            fprintf(out, "%-6lu %-6s %10lu %8lu %12lu %10lu %10.2f\n",
+                    (unsigned long) i, memories[k].name,
+                    (unsigned long) d->len, (unsigned long) m->allocs,
+                    (unsigned long) m->bytes, (unsigned long) m->peakBytes,
+                    (double) m->peakBytes / (d->len ? d->len : 1));
+        }
+    }
+    /* the peak RSS only ever grows, so it is the whole process' rather
+     * than any one document's or operation's */
+    if (bench_peak_rss_kb()) {
+        fprintf(out, "peak RSS of the whole process: %ld KB\n",
+                bench_peak_rss_kb());
+    }
+    return 0;
+}
+
+int
+main(int argc, char ** argv)
+{
+    perf_corpus corpus;
+    bench_options opts;
+    bench_result * results;
+    const char * jsonPath = NULL, * baselinePath = NULL;
+    double threshold = 5.0;
+    int perDoc = 0;
+    int selected[NUM_BENCHMARKS + NUM_SCALINGS];
+    int anySelected = 0, scaling = 0, latency = 0, memory = 0, counters = 1;
+    int rv = 0, a;
+    char ** names;
+    unsigned int i, count = 0, maxThreads = 0, maxResults;
+    FILE * out;
+
+    opts.trials = 10;
+    opts.minTrialSecs = 0.2;
+    memset((void *) selected, 0, sizeof(selected));
+    corpus_init(&corpus);
+
+    for (a = 1; a < argc; a++) {
+        if (!strcmp(argv[a], "-t") && a + 1 < argc) {
+            opts.trials = (unsigned int) atoi(argv[++a]);
+            if (opts.trials == 0) usage(argv[0]);
+        } else if (!strcmp(argv[a], "-s") && a + 1 < argc) {
+            opts.minTrialSecs = atof(argv[++a]);
+        } else if (!strcmp(argv[a], "-o") && a + 1 < argc) {
+            jsonPath = argv[++a];
+        } else if (!strcmp(argv[a], "-c") && a + 1 < argc) {
+            if (corpus_add_file(&corpus, argv[++a])) return 1;
+        } else if (!strcmp(argv[a], "-T") && a + 1 < argc) {
+            scaling = 1;
+            maxThreads = (unsigned int) atoi(argv[++a]);
+        } else if (!strcmp(argv[a], "-b") && a + 1 < argc) {
+            baselinePath = argv[++a];
+        } else if (!strcmp(argv[a], "-r") && a + 1 < argc) {
+            threshold = atof(argv[++a]);
+        } else if (!strcmp(argv[a], "-D")) {
+            perDoc = 1;
+        } else if (!strcmp(argv[a], "-M")) {
+            memory = 1;
+        } else if (!strcmp(argv[a], "-n")) {
+            counters = 0;
+        } else if (!strcmp(argv[a], "-L")) {
+            latency = 1;
+        } else {
+            /* benchmarks, then threaded workloads */
+            for (i = 0; i < NUM_BENCHMARKS + NUM_SCALINGS; i++) {
+                const char * name = i < NUM_BENCHMARKS ?
+                    benchmarks[i].name : scalings[i - NUM_BENCHMARKS].name;
+                if (!strcmp(argv[a], name)) break;
+            }
+            if (i == NUM_BENCHMARKS + NUM_SCALINGS) usage(argv[0]);
+            selected[i] = anySelected = 1;
+        }
+    }
+    if (scaling && maxThreads == 0) maxThreads = bench_num_cpus();
+
+    if (corpus.numDocs == 0) corpus_add_samples(&corpus);
+    if (corpus_prepare(&corpus)) return 1;
+
+    /* enough for every workload at 1, 2, 4... threads */
+    maxResults = NUM_BENCHMARKS;
+    for (i = 1; i < maxThreads; i *= 2) maxResults += NUM_SCALINGS;
+    maxResults += NUM_SCALINGS + NUM_LATENCIES;
+    maxResults += NUM_MEMORIES * corpus.numDocs;
+    if (perDoc) maxResults += NUM_BENCHMARKS * corpus.numDocs;
+    results = (bench_result *) calloc(maxResults, sizeof(bench_result));
+    names = (char **) calloc(maxResults, sizeof(char *));
+
+    /* with the JSON on stdout, the table goes to stderr */
+    out = (jsonPath && !strcmp(jsonPath, "-")) ? stderr : stdout;
+    fprintf(out, "-- %lu documents, %u trials of at least %gs --\n",
+            (unsigned long) corpus.numDocs, opts.trials, opts.minTrialSecs);
+
+    if (memory) {
+        rv = run_memory(&corpus, out, results, &count, names);
+    } else if (latency) {
+        rv = run_latency(&corpus, &opts, out, results, &count);
+    } else if (scaling) {
+        rv = run_scaling(&corpus, &opts, maxThreads,
+                         selected + NUM_BENCHMARKS, anySelected, out,
+                         results, &count);
+    } else {
+        if (counters && !bench_counters_open()) {
+            fprintf(stderr, "hardware counters aren't available, see "
+                    "/proc/sys/kernel/perf_event_paranoid\n");
+            counters = 0;
+        }
+        rv = run_benchmarks(&corpus, &opts, selected, anySelected, perDoc,
+                            out, results, &count, names);
+        if (counters) {
+            bench_counters_close();
+            fprintf(out, "\n");
+            bench_print_counters_header(out);
+            for (i = 0; i < count; i++) bench_print_counters(out, results + i);
+        }
+    }
+
+    if (baselinePath && rv == 0) {
+        int regressions;
+
+        fprintf(out, "\n-- compared with %s --\n", baselinePath);
+        regressions = bench_compare(out, baselinePath, results, count,
+                                    threshold);
+        if (regressions < 0) {
+            fprintf(stderr, "couldn't read the baseline %s\n",
+                    baselinePath);
+            rv = 1;
+        } else if (regressions > 0) {
+            fprintf(out, "%d regressed by more than %g%%\n", regressions,
+                    threshold);
+            rv = 2;
+        }
+    }
+
+    if (jsonPath && rv != 1 &&
+        bench_write_json(jsonPath, &opts, results, count))
+    {
+        fprintf(stderr, "couldn't write results to %s\n", jsonPath);
+        rv = 1;
+    }
+
+    for (i = 0; i < count; i++) bench_result_free(results + i);
+    for (i = 0; i < maxResults; i++) free(names[i]);
+    free(results);
+    free(names);
+    corpus_free(&corpus);
+    return rv;
+}
@@ -0,0 +1,69 @@
+#!/bin/sh
+#
+# Time json_reformat over a large generated corpus, reading it as a file
+# (which json_reformat maps into memory) and from a pipe, optionally
+# alongside another json_reformat such as one from an earlier release,
+# which read stdin through a 64KB stdio buffer.
+#
+#   reformat_bench.sh [-b BUILD_DIR] [-s SIZE] [-p PROFILE] [-o OLD_BINARY]
+#
+# SIZE takes gencorpus' suffixes and defaults to 2g.  the corpus is
+# written to $TMPDIR and removed afterwards.
+
+BUILD_DIR=build
+SIZE=2g
+PROFILE=records
+OLD=
+
+while getopts "b:s:p:o:" opt; do
+    case $opt in
+        b) BUILD_DIR=$OPTARG ;;
+        s) SIZE=$OPTARG ;;
+        p) PROFILE=$OPTARG ;;
+        o) OLD=$OPTARG ;;
+        *) sed -n '3,11p' "$0"; exit 1 ;;
+    esac
+done
+
+GENCORPUS=$BUILD_DIR/perf/gencorpus
+REFORMAT=$BUILD_DIR/reformatter/json_reformat
+for bin in $GENCORPUS $REFORMAT $OLD; do
+    if [ ! -x "$bin" ]; then
+        echo "cannot execute '$bin'"
+        exit 1
+    fi
+done
+
+CORPUS=${TMPDIR:-/tmp}/reformat_bench.$$.json
+trap 'rm -f "$CORPUS"' EXIT INT TERM
+
+$GENCORPUS -p $PROFILE -s $SIZE -o "$CORPUS" || exit 1
+BYTES=`wc -c < "$CORPUS"`
+# once through, so every run finds it in the page cache
+cat "$CORPUS" > /dev/null
+
+now() {
+    date +%s.%N
+}
+
+# run NAME COMMAND...: time a command, which reads the corpus itself
+run() {
+    name=$1
+    shift
+    start=`now`
+    "$@" > /dev/null || { echo "$name failed"; exit 1; }
+    end=`now`
+    echo "$start $end $BYTES" |
+        awk -v name="$name" '{ printf "%-24s %8.2fs %10.1f MB/s\n", name,
+                               $2 - $1, $3 / ($2 - $1) / 1048576 }'
+}
+
+echo "-- $PROFILE corpus of $BYTES bytes --"
+for flags in "" -m; do
+    run "reformat$flags file" sh -c "$REFORMAT $flags < '$CORPUS'"
+    run "reformat$flags pipe" sh -c "cat '$CORPUS' | $REFORMAT $flags"
+    if [ -n "$OLD" ]; then
+        run "old$flags file" sh -c "$OLD $flags < '$CORPUS'"
+        run "old$flags pipe" sh -c "cat '$CORPUS' | $OLD $flags"
+    fi
+done
@@ -14,6 +14,12 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+/* mapping files and reading and writing descriptors are POSIX, beyond
+ * the c99 this is built as */
+#ifndef WIN32
+#  define _POSIX_C_SOURCE 200112L
+#endif
+
 #include <yajl/yajl_parse.h>
 #include <yajl/yajl_gen.h>
 
@@ -21,6 +27,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef WIN32
+#  include <errno.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+/* input is parsed, and output written, this much at a time */
+#define REFORMAT_CHUNK_SIZE (1024 * 1024)
+
 static int reformat_null(void * ctx)
 {
     yajl_gen g = (yajl_gen) ctx;
@@ -92,12 +108,145 @@ static yajl_callbacks callbacks = {
     reformat_end_array
 };
 
+/* input comes from stdin mapped into memory when it is a regular file, or
+ * read in large chunks when it is a pipe or mapping fails */
+typedef struct {
+    unsigned char * data;
+    size_t len;
+    size_t offset;
+    int mapped;
+    /* the chunk last returned, for error messages */
+    const unsigned char * chunk;
+    size_t chunkLen;
+} reformat_input;
+
+static void
+input_open(reformat_input * in)
+{
+    memset((void *) in, 0, sizeof(reformat_input));
+#ifndef WIN32
+    {
+        struct stat st;
+        void * map;
+
+        if (fstat(0, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+            (unsigned long long) st.st_size <= (size_t) -1)
+        {
+            map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE,
+                       0, 0);
+            if (map != MAP_FAILED) {
+                posix_madvise(map, (size_t) st.st_size,
+                              POSIX_MADV_SEQUENTIAL);
+                in->data = (unsigned char *) map;
+                in->len = (size_t) st.st_size;
+                in->mapped = 1;
+                return;
+            }
+        }
+    }
+#endif
+    in->data = (unsigned char *) malloc(REFORMAT_CHUNK_SIZE);
+}
+
+/* the next chunk of input, of zero length at the end.  returns non-zero
+ * on a read error */
+static int
+input_next(reformat_input * in)
+{
+    if (in->mapped) {
+        in->chunk = in->data + in->offset;
+        in->chunkLen = in->len - in->offset;
+        if (in->chunkLen > REFORMAT_CHUNK_SIZE) {
+            in->chunkLen = REFORMAT_CHUNK_SIZE;
+        }
+        in->offset += in->chunkLen;
+        return 0;
+    }
+    in->chunk = in->data;
+#ifdef WIN32
+    in->chunkLen = fread((void *) in->data, 1, REFORMAT_CHUNK_SIZE, stdin);
+    return in->chunkLen == 0 && !feof(stdin);
+#else
+    for (;;) {
+        ssize_t rd = read(0, in->data, REFORMAT_CHUNK_SIZE);
+        if (rd < 0 && errno == EINTR) continue;
+        in->chunkLen = rd > 0 ? (size_t) rd : 0;
+        return rd < 0;
+    }
+#endif
+}
+
+static void
+input_close(reformat_input * in)
+{
+#ifndef WIN32
+    if (in->mapped) {
+        munmap((void *) in->data, in->len);
+        return;
+    }
+#endif
+    free(in->data);
+}
+
+/* output is gathered into large blocks for writing to stdout */
+typedef struct {
+    unsigned char * buf;
+    size_t len;
+    int failed;
+} reformat_output;
+
+/* write out what is gathered, remembering a failure */
+static void
+output_flush(reformat_output * out)
+{
+    const unsigned char * p = out->buf;
+    size_t len = out->len;
+
+    out->len = 0;
+    if (out->failed) return;
+#ifdef WIN32
+    if (fwrite(p, 1, len, stdout) != len) out->failed = 1;
+#else
+    while (len > 0) {
+        ssize_t wr = write(1, p, len);
+        if (wr < 0) {
+            if (errno == EINTR) continue;
+            out->failed = 1;
+            return;
+        }
+        p += wr;
+        len -= (size_t) wr;
+    }
+#endif
+}
+
+/* a yajl_print_t for the generator or the minifier.  spans as large as
+ * the buffer are written straight from where they are */
+static void
+output_print(void * ctx, const char * str, size_t len)
+{
+    reformat_output * out = (reformat_output *) ctx;
+
+    if (out->len + len > REFORMAT_CHUNK_SIZE) output_flush(out);
+    if (len >= REFORMAT_CHUNK_SIZE) {
+        unsigned char * buf = out->buf;
+        out->buf = (unsigned char *) str;
+        out->len = len;
+        output_flush(out);
+        out->buf = buf;
+        return;
+    }
+    memcpy(out->buf + out->len, str, len);
+    out->len += len;
+}
+
 static void
 usage(const char * progname)
 {
     fprintf(stderr, "%s: reformat json from stdin\n"
             "usage:  json_reformat [options]\n"
-            "    -m minimize json rather than beautify (default)\n"
+            "    -m minimize json rather than beautify (default), copying\n"
+            "       strings and numbers through as they are\n"
             "    -u allow invalid UTF8 inside strings during parsing\n"
             "    -e escape any forward slashes (for embedding in HTML)\n",
             progname);
@@ -109,36 +258,28 @@ int
 main(int argc, char ** argv)
 {
     yajl_handle hand;
-    static unsigned char fileData[65536];
+    reformat_input in;
+    reformat_output out;
     /* generator config */
-    yajl_gen g;
+    yajl_gen g = NULL;
     yajl_status stat;
-    size_t rd;
+    int minify = 0, validate = 1, escapeSolidus = 0;
     int retval = 0;
     int a = 1;
 
-    g = yajl_gen_alloc(NULL);
-    yajl_gen_config(g, yajl_gen_beautify, 1);
-    yajl_gen_config(g, yajl_gen_validate_utf8, 1);
-
-    /* ok.  open file.  let's read and parse */
-    hand = yajl_alloc(&callbacks, NULL, (void *) g);
-    /* and let's allow comments by default */
-    yajl_config(hand, yajl_allow_comments, 1);
-
     /* check arguments.*/
     while ((a < argc) && (argv[a][0] == '-') && (strlen(argv[a]) > 1)) {
         unsigned int i;
         for ( i=1; i < strlen(argv[a]); i++) {
             switch (argv[a][i]) {
                 case 'm':
-                    yajl_gen_config(g, yajl_gen_beautify, 0);
+                    minify = 1;
                     break;
                 case 'u':
-                    yajl_config(hand, yajl_dont_validate_strings, 1);
+                    validate = 0;
                     break;
                 case 'e':
-                    yajl_gen_config(g, yajl_gen_escape_solidus, 1);
+                    escapeSolidus = 1;
                     break;
                 default:
                     fprintf(stderr, "unrecognized option: '%c'\n\n",
@@ -152,43 +293,70 @@ main(int argc, char ** argv)
         usage(argv[0]);
     }
 
+    out.buf = (unsigned char *) malloc(REFORMAT_CHUNK_SIZE);
+    out.len = 0;
+    out.failed = 0;
 
-    for (;;) {
-        rd = fread((void *) fileData, 1, sizeof(fileData) - 1, stdin);
+    /* minifying copies tokens straight through from the parser, unless
+     * slashes must be escaped, which takes the generator */
+    if (minify && !escapeSolidus) {
+        hand = yajl_alloc(NULL, NULL, NULL);
+        yajl_config(hand, yajl_minify, output_print, (void *) &out);
+    } else {
+        g = yajl_gen_alloc(NULL);
+        yajl_gen_config(g, yajl_gen_beautify, !minify);
+        yajl_gen_config(g, yajl_gen_validate_utf8, 1);
+        yajl_gen_config(g, yajl_gen_escape_solidus, escapeSolidus);
+        yajl_gen_config(g, yajl_gen_print_callback, output_print,
+                        (void *) &out);
+        hand = yajl_alloc(&callbacks, NULL, (void *) g);
+    }
+    /* and let's allow comments by default */
+    yajl_config(hand, yajl_allow_comments, 1);
+    yajl_config(hand, yajl_dont_validate_strings, !validate);
 
-        if (rd == 0) {
-            if (!feof(stdin)) {
-                fprintf(stderr, "error on file read.\n");
-                retval = 1;
-            }
+    input_open(&in);
+    for (;;) {
+        if (input_next(&in)) {
+            fprintf(stderr, "error on file read.\n");
+            retval = 1;
             break;
         }
-        fileData[rd] = 0;
+        if (in.chunkLen == 0) break;
 
-        stat = yajl_parse(hand, fileData, rd);
+        stat = yajl_parse(hand, in.chunk, in.chunkLen);
 
         if (stat != yajl_status_ok) break;
 
-        {
-            const unsigned char * buf;
-            size_t len;
-            yajl_gen_get_buf(g, &buf, &len);
-            fwrite(buf, 1, len, stdout);
-            yajl_gen_clear(g);
+        if (out.failed) {
+            fprintf(stderr, "error on write.\n");
+            retval = 1;
+            break;
         }
     }
 
     stat = yajl_complete_parse(hand);
 
+    /* completing the parse may have produced more, such as a top level
+     * number which only ended at the end of input.  on an error, what
+     * was formatted up to it is still written out */
+    output_flush(&out);
+    if (out.failed && retval == 0) {
+        fprintf(stderr, "error on write.\n");
+        retval = 1;
+    }
+
     if (stat != yajl_status_ok) {
-        unsigned char * str = yajl_get_error(hand, 1, fileData, rd);
+        unsigned char * str = yajl_get_error(hand, 1, in.chunk, in.chunkLen);
         fprintf(stderr, "%s", (const char *) str);
         yajl_free_error(hand, str);
         retval = 1;
     }
 
-    yajl_gen_free(g);
+    input_close(&in);
+    if (g) yajl_gen_free(g);
     yajl_free(hand);
+    free(out.buf);
 
     return retval;
 }
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2007-2011, Lloyd Hilaiel <lloyd@hilaiel.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file yajl_arena.h
+ * An arena allocator which plugs into yajl_alloc_funcs.
+ *
+ * An arena hands out memory from large blocks and releases it all at
+ * once, which suits parsing, generating and tree building scoped to a
+ * single request.  Growing the most recent allocation happens in place,
+ * the pattern of yajl's buffers and stacks, and freeing it hands the
+ * memory back; other frees do nothing until the arena is reset.  Blocks
+ * are kept across resets, so a reused arena stops calling the backing
+ * allocator once it has grown to fit its workload.
+ *
+ *   yajl_alloc_funcs afs;
+ *   yajl_arena arena = yajl_arena_alloc(NULL, 0);
+ *   yajl_arena_get_alloc_funcs(arena, &afs);
+ *   for (;;) {
+ *       yajl_handle h = yajl_alloc(&callbacks, &afs, ctx);
+ *       ... parse a request, no need to yajl_free(h) ...
+ *       yajl_arena_clear(arena);
+ *   }
+ *
+ * An arena is not thread safe.
+ */
+
+#ifndef __YAJL_ARENA_H__
+#define __YAJL_ARENA_H__
+
+#include <yajl/yajl_common.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /** an opaque handle to an arena */
+    typedef struct yajl_arena_t * yajl_arena;
+
+    /** a position in an arena to reset to, see yajl_arena_get_mark() */
+    typedef struct {
+        void * block;
+        size_t used;
+    } yajl_arena_mark;
+
+    /** allocate an arena
+     *  \param afs        the allocation functions arena blocks come from,
+     *                    may be NULL for malloc and friends
+     *  \param blockSize  the size of arena blocks, zero for 64KB.
+     *                    Larger allocations get a block of their own.
+     */
+    YAJL_API yajl_arena yajl_arena_alloc(yajl_alloc_funcs * afs,
+                                         size_t blockSize);
+
+    /** free an arena and all memory allocated from it */
+    YAJL_API void yajl_arena_free(yajl_arena arena);
+
+    /** fill in allocation functions which allocate from the arena, for
+     *  passing to yajl_alloc(), yajl_gen_alloc() and
+     *  yajl_tree_parse_alloc() */
+    YAJL_API void yajl_arena_get_alloc_funcs(yajl_arena arena,
+                                             yajl_alloc_funcs * afs);
+
+    /** get the arena's current position */
+    YAJL_API yajl_arena_mark yajl_arena_get_mark(yajl_arena arena);
+
+    /** release everything allocated since mark was taken */
+    YAJL_API void yajl_arena_reset(yajl_arena arena,
+                                   const yajl_arena_mark * mark);
+
+    /** release everything allocated from the arena, keeping its blocks */
+    YAJL_API void yajl_arena_clear(yajl_arena arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -53,6 +53,12 @@ typedef void (*yajl_free_func)(void *ctx, void * ptr);
 /** pointer to a realloc function which can resize an allocation. */
 typedef void * (*yajl_realloc_func)(void *ctx, void * ptr, size_t sz);
 
+/** a callback used for "printing" the results of the generator, or of
+ *  a minifying parser. */
+typedef void (*yajl_print_t)(void * ctx,
+                             const char * str,
+                             size_t len);
+
 /** A structure which can be passed to yajl_*_alloc routines to allow the
  *  client to specify memory allocation functions to be used. */
 typedef struct
@@ -68,6 +74,47 @@ typedef struct
     void * ctx;
 } yajl_alloc_funcs;
 
+/** allocation statistics, see yajl_get_mem_stats(),
+ *  yajl_gen_get_mem_stats() and yajl_mem_tracker */
+typedef struct
+{
+    /** the number of allocations */
+    size_t allocs;
+    /** the number of reallocations */
+    size_t reallocs;
+    /** the number of frees */
+    size_t frees;
+    /** the number of bytes currently allocated */
+    size_t bytes;
+    /** the most bytes allocated at once */
+    size_t peakBytes;
+    /** the sum of the sizes of all allocations and reallocations */
+    size_t totalBytes;
+} yajl_mem_stats;
+
+/** Allocation functions which keep statistics on the allocations they
+ *  pass on to some other allocation functions.  Pass funcs wherever yajl
+ *  takes allocation functions, for instance to yajl_tree_parse_alloc(),
+ *  and read stats to see what was allocated.  A tracker must stay put
+ *  for as long as its functions are in use. */
+typedef struct
+{
+    /** the allocation functions to use, which keep stats */
+    yajl_alloc_funcs funcs;
+    /** the allocation functions memory really comes from */
+    yajl_alloc_funcs backing;
+    /** statistics on allocations made through funcs */
+    yajl_mem_stats stats;
+} yajl_mem_tracker;
+
+/** initialize a tracker
+ *  \param tracker  the tracker to set up
+ *  \param backing  the allocation functions memory comes from, may be
+ *                  NULL for malloc and friends
+ */
+YAJL_API void yajl_mem_tracker_init(yajl_mem_tracker * tracker,
+                                    const yajl_alloc_funcs * backing);
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,7 +37,7 @@ extern "C" {
          *  yajl_gen_string was called */
         yajl_gen_keys_must_be_strings,
         /** YAJL's maximum generation depth was exceeded.  see
-         *  YAJL_MAX_DEPTH */
+         *  yajl_gen_max_depth */
         yajl_max_depth_exceeded,
         /** A generator function (yajl_gen_XXX) was called while in an error
          *  state */
@@ -53,16 +53,36 @@ extern "C" {
         /** returned from yajl_gen_string() when the yajl_gen_validate_utf8
          *  option is enabled and an invalid was passed by client code.
          */
-        yajl_gen_invalid_string
+        yajl_gen_invalid_string,
+        /** a generator function other than yajl_gen_string_append() or
+         *  yajl_gen_string_end() was called while a string started with
+         *  yajl_gen_string_begin() was still open */
+        yajl_gen_string_in_progress,
+        /** yajl_gen_string_append() or yajl_gen_string_end() was called
+         *  without a preceding call to yajl_gen_string_begin() */
+        yajl_gen_no_string_in_progress,
+        /** the output of the call did not fit in the fixed output buffer
+         *  set with yajl_gen_output_buffer.  The call had no effect: drain
+         *  the buffer (yajl_gen_get_buf), yajl_gen_clear() it and repeat
+         *  the call. */
+        yajl_gen_buffer_full,
+        /** yajl_gen_splice() was passed a fragment which doesn't fit the
+         *  generator's current position, or a fragment generator was asked
+         *  to close the container it generates members of */
+        yajl_gen_fragment_mismatch
     } yajl_gen_status;
 
     /** an opaque handle to a generator */
     typedef struct yajl_gen_t * yajl_gen;
 
-    /** a callback used for "printing" the results. */
-    typedef void (*yajl_print_t)(void * ctx,
-                                 const char * str,
-                                 size_t len);
+    /** one entry of the scatter-gather list built when
+     *  yajl_gen_iovec_output is set.  The layout mirrors POSIX
+     *  struct iovec, so the list may be passed to writev() or sendmsg()
+     *  with a cast. */
+    typedef struct {
+        const void * iov_base;
+        size_t iov_len;
+    } yajl_gen_iovec;
 
     /** configuration parameters for the parser, these may be passed to
      *  yajl_gen_config() along with option specific argument(s).  In general,
@@ -98,7 +118,69 @@ extern "C" {
          * iterest of saving bytes.  Setting this flag will cause YAJL to
          * always escape '/' in generated JSON strings.
          */
-        yajl_gen_escape_solidus = 0x10
+        yajl_gen_escape_solidus = 0x10,
+        /**
+         * Generate output directly into a caller-provided buffer of fixed
+         * size, rather than an internal, growing one.  No memory is
+         * allocated for output.  Takes an unsigned char * to the buffer
+         * and a size_t length.
+         *
+         * Each generator call either writes all of its output or, if
+         * that would not fit, writes nothing and returns
+         * yajl_gen_buffer_full, leaving the generator state untouched.
+         * yajl_gen_get_buf() returns the bytes written by completed
+         * calls; once they're consumed, yajl_gen_clear() rewinds to the
+         * start of the buffer and the failed call may be repeated.
+         * A value which is larger than the whole buffer can be split
+         * with yajl_gen_string_append().
+         *
+         * example:
+         *   yajl_gen_config(g, yajl_gen_output_buffer, buf, (size_t) len);
+         */
+        yajl_gen_output_buffer = 0x20,
+        /**
+         * Build output as a scatter-gather list (see yajl_gen_get_iovec())
+         * instead of a single buffer.  Runs of string contents and
+         * yajl_gen_number() text at least as long as the size_t threshold
+         * argument are not copied: list entries point straight into the
+         * memory passed to the generator, which the client must keep
+         * alive until the list has been written.  Shorter runs,
+         * punctuation and escape sequences are copied into a side buffer.
+         * Pass 0 for a default threshold of 256 bytes.  Thresholds
+         * smaller than 16 bytes are raised to 16.
+         *
+         * example:
+         *   yajl_gen_config(g, yajl_gen_iovec_output, (size_t) 1024);
+         */
+        yajl_gen_iovec_output = 0x40,
+        /**
+         * Set the maximum nesting depth of generated JSON, as an unsigned
+         * int.  Opening a container at the maximum depth fails with
+         * yajl_max_depth_exceeded.  The default is YAJL_MAX_DEPTH, zero
+         * removes the limit.  Generator state costs one byte per level
+         * of nesting actually used.
+         *
+         * example:
+         *   yajl_gen_config(g, yajl_gen_max_depth, 4096u);
+         */
+        yajl_gen_max_depth = 0x80,
+        /**
+         * Compress output with gzip.  The int argument is a zlib
+         * compression level from 0 to 9, or -1 for zlib's default.
+         * Compression is placed in front of the output configured so
+         * far (the internal buffer or a print callback), which receives
+         * the gzip stream; set any print callback first.  Output is
+         * compressed in 64KB blocks and the stream is ended when the
+         * document is complete.  Use yajl_gen_flush() to push partial
+         * output through mid-document.  Not available with
+         * yajl_gen_output_buffer or yajl_gen_iovec_output, nor when yajl
+         * was built without zlib: yajl_gen_config() then returns zero.
+         * Reconfiguring the output drops the compressor.
+         *
+         * example:
+         *   yajl_gen_config(g, yajl_gen_gzip_output, 6);
+         */
+        yajl_gen_gzip_output = 0x100
     } yajl_gen_option;
 
     /** allow the modification of generator options subsequent to handle
@@ -117,6 +199,31 @@ extern "C" {
      */
     YAJL_API yajl_gen yajl_gen_alloc(const yajl_alloc_funcs * allocFuncs);
 
+    /** the kind of container whose members a fragment generator produces */
+    typedef enum {
+        yajl_gen_fragment_array,
+        yajl_gen_fragment_object
+    } yajl_gen_fragment_context;
+
+    /** allocate a fragment generator, which produces a run of members of
+     *  an array or object without the enclosing brackets.  Fragments may
+     *  be generated independently (for instance on several threads) and
+     *  joined into a parent generator with yajl_gen_splice(), which adds
+     *  the separators between runs.
+     *
+     *  \param allocFuncs as for yajl_gen_alloc()
+     *  \param context    whether members are array elements or object
+     *                    key/value pairs
+     *  \param depth      the nesting depth the members will be spliced
+     *                    in at, 1 for members of a top level container.
+     *                    Used to indent beautified output.
+     *
+     *  \returns an allocated handle on success, NULL on failure (bad params)
+     */
+    YAJL_API yajl_gen yajl_gen_alloc_fragment(const yajl_alloc_funcs * allocFuncs,
+                                              yajl_gen_fragment_context context,
+                                              unsigned int depth);
+
     /** free a generator handle */
     YAJL_API void yajl_gen_free(yajl_gen handle);
 
@@ -131,6 +238,28 @@ extern "C" {
     YAJL_API yajl_gen_status yajl_gen_string(yajl_gen hand,
                                              const unsigned char * str,
                                              size_t len);
+
+    /** begin generating a string whose contents will be supplied in
+     *  pieces via yajl_gen_string_append().  This allows very large
+     *  strings to be emitted without ever holding them in memory in
+     *  one buffer.  The string may be used anywhere yajl_gen_string()
+     *  may, including as a map key.  Until yajl_gen_string_end() is
+     *  called all other generator functions return
+     *  yajl_gen_string_in_progress. */
+    YAJL_API yajl_gen_status yajl_gen_string_begin(yajl_gen hand);
+    /** append a piece of the string opened with yajl_gen_string_begin().
+     *  Pieces are escaped as they are appended and need not be split on
+     *  UTF8 character boundaries.  When yajl_gen_validate_utf8 is enabled
+     *  a multi-byte sequence may span appends, and an invalid piece is
+     *  rejected with yajl_gen_invalid_string without generating output. */
+    YAJL_API yajl_gen_status yajl_gen_string_append(yajl_gen hand,
+                                                    const unsigned char * str,
+                                                    size_t len);
+    /** close the string opened with yajl_gen_string_begin().  When
+     *  yajl_gen_validate_utf8 is enabled and the string ends in the
+     *  middle of a multi-byte sequence, yajl_gen_invalid_string is
+     *  returned and the string is left open. */
+    YAJL_API yajl_gen_status yajl_gen_string_end(yajl_gen hand);
     YAJL_API yajl_gen_status yajl_gen_null(yajl_gen hand);
     YAJL_API yajl_gen_status yajl_gen_bool(yajl_gen hand, int boolean);
     YAJL_API yajl_gen_status yajl_gen_map_open(yajl_gen hand);
@@ -138,13 +267,54 @@ extern "C" {
     YAJL_API yajl_gen_status yajl_gen_array_open(yajl_gen hand);
     YAJL_API yajl_gen_status yajl_gen_array_close(yajl_gen hand);
 
+    /** append the members generated so far by a fragment generator to
+     *  the array or object that hand is currently inside of.  The
+     *  fragment must match the parent's container type, depth and
+     *  yajl_gen_beautify setting, and must not have an unfinished member.
+     *  Fragments must use the default output buffer.  The fragment's
+     *  output is not consumed; yajl_gen_clear() it before generating
+     *  further members to splice.
+     *
+     *  When hand builds iovec output, the fragment's buffer is referenced
+     *  rather than copied, so it must be left untouched until the list
+     *  has been written.
+     */
+    YAJL_API yajl_gen_status yajl_gen_splice(yajl_gen hand, yajl_gen fragment);
+
     /** access the null terminated generator buffer.  If incrementally
      *  outputing JSON, one should call yajl_gen_clear to clear the
-     *  buffer.  This allows stream generation. */
+     *  buffer.  This allows stream generation.  When a fixed output
+     *  buffer is in use, the caller's buffer is returned and is not
+     *  null terminated. */
     YAJL_API yajl_gen_status yajl_gen_get_buf(yajl_gen hand,
                                               const unsigned char ** buf,
                                               size_t * len);
 
+    /** access the scatter-gather list built when yajl_gen_iovec_output
+     *  is set.  The list and the side buffer it refers to remain valid
+     *  until the next call to the generator.  Call yajl_gen_clear to
+     *  start a new list once the output has been written.
+     *  \returns yajl_gen_no_buf when the generator isn't building a list
+     */
+    YAJL_API yajl_gen_status yajl_gen_get_iovec(yajl_gen hand,
+                                                const yajl_gen_iovec ** iov,
+                                                size_t * count);
+
+    /** push output held back by the generator through to the output
+     *  buffer or print callback.  With gzip output, everything generated
+     *  so far can then be decompressed by the receiver, at some cost in
+     *  compression.  Otherwise output is never held back and this does
+     *  nothing. */
+    YAJL_API yajl_gen_status yajl_gen_flush(yajl_gen hand);
+
+    /** get the statistics of the yajl_mem_tracker whose functions the
+     *  generator was allocated with.  Tracking is opt-in: pass a
+     *  tracker's funcs to yajl_gen_alloc() to keep stats, which then
+     *  cover the generator itself and anything else allocated through
+     *  the tracker.  Otherwise the stats are all zero */
+    YAJL_API void yajl_gen_get_mem_stats(yajl_gen hand,
+                                         yajl_mem_stats * stats);
+
     /** clear yajl's output buffer, but maintain all internal generation
      *  state.  This function will not "reset" the generator state, and is
      *  intended to enable incremental JSON outputing. */
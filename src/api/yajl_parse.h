@@ -37,7 +37,10 @@ extern "C" {
         yajl_status_client_canceled,
         /** An error occured during the parse.  Call yajl_get_error for
          *  more information about the encountered error */
-        yajl_status_error
+        yajl_status_error,
+        /** the handle needed more memory than yajl_max_memory allows.
+         *  The handle is left in an error state */
+        yajl_status_memory_limit
     } yajl_status;
 
     /** attain a human readable, english, string for an error */
@@ -109,6 +112,11 @@ extern "C" {
                                     void * ctx);
 
 
+    /** a function which provides memory for a string of len bytes plus a
+     *  NUL terminator, see yajl_string_alloc */
+    typedef unsigned char * (*yajl_string_alloc_func)(void * ctx,
+                                                      size_t len);
+
     /** configuration parameters for the parser, these may be passed to
      *  yajl_config() along with option specific argument(s).  In general,
      *  all configuration parameters default to *off*. */
@@ -156,7 +164,64 @@ extern "C" {
          * yajl will enter an error state (premature EOF).  Setting this
          * flag suppresses that check and the corresponding error.
          */
-        yajl_allow_partial_values = 0x10
+        yajl_allow_partial_values = 0x10,
+        /**
+         * Deliver strings and map keys in memory provided by the client,
+         * so that they can be kept without copying them again.  The
+         * argument is a yajl_string_alloc_func, which is called with the
+         * context pointer given to yajl_alloc() and the exact decoded
+         * length of each string or key before its callback.  It returns
+         * memory for that many bytes plus a terminating NUL, which yajl
+         * decodes the string straight into and then passes to the
+         * callback.  The memory then belongs to the client.  Returning
+         * NULL fails the parse with yajl_status_error.  Pass NULL to go
+         * back to strings that are only valid during the callback.
+         *
+         * example:
+         *   yajl_config(h, yajl_string_alloc, my_arena_alloc);
+         */
+        yajl_string_alloc = 0x20,
+        /**
+         * Limit the memory a handle may hold, in bytes, as a size_t.
+         * This covers the handle itself and the buffers and state stack
+         * it grows for long tokens and deep nesting, but not memory
+         * handed out through yajl_string_alloc.  The limit is checked as
+         * each yajl_parse() or yajl_complete_parse() call returns, so it
+         * may be overshot by about the size of the chunk passed in; going
+         * over it fails the parse with yajl_status_memory_limit.  Zero,
+         * the default, is no limit.
+         *
+         * example:
+         *   yajl_config(h, yajl_max_memory, (size_t) 1 << 20);
+         */
+        yajl_max_memory = 0x40,
+        /**
+         * Give back memory grown for an oversized token once it is no
+         * longer needed.  As each yajl_parse() or yajl_complete_parse()
+         * call returns, buffers and the state stack grown beyond the
+         * size_t argument, in bytes, are shrunk back to it when what
+         * they hold fits.  Zero, the default, keeps memory for reuse.
+         *
+         * example:
+         *   yajl_config(h, yajl_trim_buffers, (size_t) 65536);
+         */
+        yajl_trim_buffers = 0x80,
+        /**
+         * Write the input text, minified, to a yajl_print_t function as
+         * it is parsed.  Whitespace and comments are dropped, and every
+         * other token is copied through exactly as it appears, so strings
+         * and numbers are neither decoded nor re-encoded.  Tokens which
+         * are adjacent in the input go out in a single call.  With
+         * yajl_allow_multiple_values each value is followed by a newline.
+         * Callbacks are still made, so allocate the handle with NULL
+         * callbacks to only minify.  The output is only valid JSON if the
+         * parse succeeds.  The arguments are the function and a context
+         * pointer for it; a NULL function turns minifying off.
+         *
+         * example:
+         *   yajl_config(h, yajl_minify, myPrintFunc, myVoidPtr);
+         */
+        yajl_minify = 0x100
     } yajl_option;
 
     /** allow the modification of parser options subsequent to handle
@@ -168,6 +233,95 @@ extern "C" {
     /** free a parser handle */
     YAJL_API void yajl_free(yajl_handle handle);
 
+    /** get the statistics of the yajl_mem_tracker whose functions the
+     *  handle was allocated with.  Tracking is opt-in: pass a tracker's
+     *  funcs to yajl_alloc() or yajl_handle_pool_alloc() to keep stats,
+     *  which then cover the handle itself and anything else allocated
+     *  through the tracker, such as the other handles of a pool.
+     *  Otherwise the stats are all zero */
+    YAJL_API void yajl_get_mem_stats(yajl_handle hand,
+                                     yajl_mem_stats * stats);
+
+    /** statistics on the work a handle has done, from yajl_get_stats() */
+    typedef struct {
+        /** calls to yajl_parse() and bytes passed to them */
+        size_t parseCalls;
+        size_t bytesParsed;
+        /** tokens lexed, by type.  strings count map keys as well as
+         *  string values, split by whether they contain escapes */
+        size_t nullTokens;
+        size_t boolTokens;
+        size_t integerTokens;
+        size_t doubleTokens;
+        size_t cleanStrings;
+        size_t escapedStrings;
+        /** '{' and '[', '}' and ']', ',' and ':' */
+        size_t openTokens;
+        size_t closeTokens;
+        size_t separatorTokens;
+        /** tokens which crossed the end of a buffer passed to
+         *  yajl_parse() and were assembled in the lexer, and their bytes */
+        size_t bufferedTokens;
+        size_t bufferedBytes;
+        /** bytes of strings and numbers copied out to be decoded */
+        size_t decodedBytes;
+        /** the deepest nesting of maps and arrays seen */
+        size_t maxDepth;
+        /** every 64th call to yajl_parse() is timed, and its time split
+         *  between callbacks and the library.  Scale these by
+         *  parseCalls / sampledCalls to estimate the totals */
+        size_t sampledCalls;
+        unsigned long long sampledCallbackNs;
+        unsigned long long sampledLibraryNs;
+    } yajl_stats;
+
+    /** get statistics on the work a handle has done since it was
+     *  allocated, or handed out from a pool.  If yajl was built with
+     *  YAJL_NO_STATS they are all zero.
+     *
+     *  Timing is sampled per handle, on its 64th, 128th... call to
+     *  yajl_parse(), so that the clock is rarely read.  A handle which
+     *  parses its input in fewer than 64 calls, as when a whole document
+     *  is passed in one buffer, is never timed: sampledCalls and the
+     *  sampled times stay zero while the counts are still kept.  To
+     *  time such parses, time the calls themselves.
+     *  \returns zero if statistics are not compiled in, non-zero
+     *           otherwise
+     */
+    YAJL_API int yajl_get_stats(yajl_handle hand, yajl_stats * stats);
+
+    /** A pool of parser handles for reuse.  Parsing many small documents
+     *  with fresh handles spends much of its time allocating; a pooled
+     *  handle is a single allocation, handed back out with its state
+     *  reset and any buffers it grew kept.  A pool is not thread safe:
+     *  keep one per thread. */
+    typedef struct yajl_handle_pool_t * yajl_handle_pool;
+
+    /** allocate a handle pool
+     *  \param callbacks  the callbacks used by the pool's handles, as
+     *                    passed to yajl_alloc()
+     *  \param afs        memory allocation functions for the pool and its
+     *                    handles, may be NULL
+     *  \param max        the most idle handles the pool keeps
+     */
+    YAJL_API yajl_handle_pool yajl_handle_pool_alloc(
+        const yajl_callbacks * callbacks, yajl_alloc_funcs * afs,
+        unsigned int max);
+
+    /** free a handle pool along with its idle handles */
+    YAJL_API void yajl_handle_pool_free(yajl_handle_pool pool);
+
+    /** get a handle from the pool, allocating one if none are idle.  The
+     *  handle is in the state yajl_alloc() leaves it in, with ctx as its
+     *  context pointer and all options off. */
+    YAJL_API yajl_handle yajl_handle_pool_get(yajl_handle_pool pool,
+                                              void * ctx);
+
+    /** return a handle from yajl_handle_pool_get() to the pool, or free
+     *  it if the pool is full */
+    YAJL_API void yajl_handle_pool_put(yajl_handle_pool pool,
+                                       yajl_handle handle);
+
     /** Parse some json!
      *  \param hand - a handle to the json parser allocated with yajl_alloc
      *  \param jsonText - a pointer to the UTF8 json text to be parsed
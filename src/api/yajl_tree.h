@@ -129,6 +129,29 @@ YAJL_API yajl_val yajl_tree_parse (const char *input,
  */
 YAJL_API void yajl_tree_free (yajl_val v);
 
+/**
+ * Parse a string, allocating the tree with the given functions.
+ *
+ * Like \em yajl_tree_parse, but all memory used while parsing and for the
+ * returned tree comes from \em afs, which may be \c NULL for malloc and
+ * friends.  With allocation functions from an arena (see yajl_arena.h)
+ * the tree may be released by clearing the arena rather than freeing it.
+ * To watch a tree's allocations, parse it with the functions of a
+ * yajl_mem_tracker.
+ */
+YAJL_API yajl_val yajl_tree_parse_alloc (const char *input,
+                                         yajl_alloc_funcs *afs,
+                                         char *error_buffer,
+                                         size_t error_buffer_size);
+
+/**
+ * Free a parse tree returned by "yajl_tree_parse_alloc".
+ *
+ * \param v   Pointer to a JSON value, or NULL for a no-op.
+ * \param afs The allocation functions the tree was parsed with.
+ */
+YAJL_API void yajl_tree_free_alloc (yajl_val v, yajl_alloc_funcs *afs);
+
 /**
  * Access a nested value inside a tree.
  *
@@ -18,6 +18,7 @@
 #include "yajl_lex.h"
 #include "yajl_parser.h"
 #include "yajl_alloc.h"
+#include "yajl_trace.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -38,10 +39,15 @@ yajl_status_to_string(yajl_status stat)
         case yajl_status_error:
             statStr = "parse error";
             break;
+        case yajl_status_memory_limit:
+            statStr = "memory limit exceeded";
+            break;
     }
     return statStr;
 }
 
+static void yajl_reset(yajl_handle hand, void * ctx);
+
 yajl_handle
 yajl_alloc(const yajl_callbacks * callbacks,
            yajl_alloc_funcs * afs,
@@ -62,20 +68,59 @@ yajl_alloc(const yajl_callbacks * callbacks,
     }
 
     hand = (yajl_handle) YA_MALLOC(afs, sizeof(struct yajl_handle_t));
+    if (!hand) return NULL;
 
     /* copy in pointers to allocation routines */
     memcpy((void *) &(hand->alloc), (void *) afs, sizeof(yajl_alloc_funcs));
 
     hand->callbacks = callbacks;
+    yajl_lex_init(&(hand->lexerStore), &(hand->alloc), 0, 1);
+    hand->decodeBuf = &(hand->decodeBufStore);
+    yajl_buf_init(hand->decodeBuf, &(hand->alloc), hand->decodeBufInline,
+                  sizeof(hand->decodeBufInline));
+    yajl_bs_init_inline(hand->stateStack, &(hand->alloc),
+                        hand->stateStackInline,
+                        sizeof(hand->stateStackInline));
+    yajl_reset(hand, ctx);
+
+    return hand;
+}
+
+/* return a handle to its freshly allocated state, keeping its memory */
+static void
+yajl_reset(yajl_handle hand, void * ctx)
+{
     hand->ctx = ctx;
-    hand->lexer = NULL; 
+    hand->lexer = NULL;
+    hand->parseError = NULL;
     hand->bytesConsumed = 0;
-    hand->decodeBuf = yajl_buf_alloc(&(hand->alloc));
-    hand->flags	    = 0;
-    yajl_bs_init(hand->stateStack, &(hand->alloc));
+    yajl_buf_clear(hand->decodeBuf);
+    hand->stringAlloc = NULL;
+    hand->maxMemory = 0;
+    hand->trimSize = 0;
+    hand->minifyPrint = NULL;
+    hand->minifyCtx = NULL;
+    hand->minifyRunLen = 0;
+    hand->flags = 0;
+#ifndef YAJL_NO_STATS
+    memset((void *) &(hand->stats), 0, sizeof(yajl_stats));
+    hand->timing = 0;
+#endif
+    yajl_bs_clear(hand->stateStack);
     yajl_bs_push(hand->stateStack, yajl_state_start);
+}
 
-    return hand;
+/* the lexer is set up on the first call to parse, once the options are
+ * known */
+static void
+yajl_start_lexer(yajl_handle hand)
+{
+    if (hand->lexer == NULL) {
+        hand->lexer = &(hand->lexerStore);
+        yajl_lex_reset(hand->lexer,
+                       hand->flags & yajl_allow_comments,
+                       !(hand->flags & yajl_dont_validate_strings));
+    }
 }
 
 int
@@ -94,6 +139,19 @@ yajl_config(yajl_handle h, yajl_option opt, ...)
             if (va_arg(ap, int)) h->flags |= opt;
             else h->flags &= ~opt;
             break;
+        case yajl_string_alloc:
+            h->stringAlloc = va_arg(ap, yajl_string_alloc_func);
+            break;
+        case yajl_max_memory:
+            h->maxMemory = va_arg(ap, size_t);
+            break;
+        case yajl_trim_buffers:
+            h->trimSize = va_arg(ap, size_t);
+            break;
+        case yajl_minify:
+            h->minifyPrint = va_arg(ap, yajl_print_t);
+            h->minifyCtx = va_arg(ap, void *);
+            break;
         default:
             rv = 0;
     }
@@ -106,28 +164,142 @@ void
 yajl_free(yajl_handle handle)
 {
     yajl_bs_free(handle->stateStack);
-    yajl_buf_free(handle->decodeBuf);
-    if (handle->lexer) {
-        yajl_lex_free(handle->lexer);
-        handle->lexer = NULL;
-    }
+    yajl_buf_release(handle->decodeBuf);
+    yajl_lex_release(&(handle->lexerStore));
     YA_FREE(&(handle->alloc), handle);
 }
 
+void
+yajl_get_mem_stats(yajl_handle hand, yajl_mem_stats * stats)
+{
+    yajl_mem_tracker_stats(&(hand->alloc), stats);
+}
+
+int
+yajl_get_stats(yajl_handle hand, yajl_stats * stats)
+{
+#ifndef YAJL_NO_STATS
+    const size_t * tokens = hand->lexerStore.tokenCounts;
+
+    memcpy((void *) stats, (void *) &(hand->stats), sizeof(yajl_stats));
+    /* the lexer counts are only set up by the first parse call */
+    if (hand->lexer == NULL) return 1;
+
+    stats->nullTokens = tokens[yajl_tok_null];
+    stats->boolTokens = tokens[yajl_tok_bool];
+    stats->integerTokens = tokens[yajl_tok_integer];
+    stats->doubleTokens = tokens[yajl_tok_double];
+    stats->cleanStrings = tokens[yajl_tok_string];
+    stats->escapedStrings = tokens[yajl_tok_string_with_escapes];
+    stats->openTokens =
+        tokens[yajl_tok_left_brace] + tokens[yajl_tok_left_bracket];
+    stats->closeTokens =
+        tokens[yajl_tok_right_brace] + tokens[yajl_tok_right_bracket];
+    stats->separatorTokens = tokens[yajl_tok_comma] + tokens[yajl_tok_colon];
+    stats->bufferedTokens = hand->lexerStore.bufferedTokens;
+    stats->bufferedBytes = hand->lexerStore.bufferedBytes;
+    return 1;
+#else
+    memset((void *) stats, 0, sizeof(yajl_stats));
+    return 0;
+#endif
+}
+
+#ifndef YAJL_NO_STATS
+/* count a parse call, and time the last of every
+ * YAJL_STATS_SAMPLE_INTERVAL.  timing puts a clock read around every
+ * callback, so a document parsed in one call is never timed */
+static unsigned long long
+yajl_stats_begin(yajl_handle hand, size_t jsonTextLen)
+{
+    hand->stats.bytesParsed += jsonTextLen;
+    hand->timing = (++hand->stats.parseCalls %
+                    YAJL_STATS_SAMPLE_INTERVAL) == 0;
+    return hand->timing ? yajl_stats_clock() : 0;
+}
+
+static void
+yajl_stats_end(yajl_handle hand, unsigned long long start,
+               unsigned long long callbackNs)
+{
+    if (hand->timing) {
+        unsigned long long elapsed = yajl_stats_clock() - start;
+        callbackNs = hand->stats.sampledCallbackNs - callbackNs;
+        hand->stats.sampledCalls++;
+        hand->stats.sampledLibraryNs +=
+            elapsed > callbackNs ? elapsed - callbackNs : 0;
+        hand->timing = 0;
+    }
+}
+#endif
+
+/* memory held by the handle itself and grown for its buffers */
+static size_t
+yajl_memory_used(yajl_handle hand)
+{
+    size_t used = sizeof(struct yajl_handle_t);
+    used += yajl_buf_allocated(hand->decodeBuf);
+    used += yajl_buf_allocated(hand->lexerStore.buf);
+    if (hand->stateStack.stack != hand->stateStack.inlineStack) {
+        used += hand->stateStack.size;
+    }
+    return used;
+}
+
+/* shrink buffers and the state stack back to trimSize where what they
+ * hold fits */
+static void
+yajl_trim(yajl_handle hand)
+{
+    yajl_bytestack * stack = &(hand->stateStack);
+
+    /* decoded strings are only needed during their callbacks */
+    yajl_buf_clear(hand->decodeBuf);
+    yajl_buf_trim(hand->decodeBuf, hand->trimSize);
+    yajl_buf_trim(hand->lexerStore.buf, hand->trimSize);
+
+    if (stack->stack != stack->inlineStack && stack->size > hand->trimSize &&
+        stack->used <= sizeof(hand->stateStackInline))
+    {
+        memcpy(stack->inlineStack, stack->stack, stack->used);
+        YA_FREE(&(hand->alloc), stack->stack);
+        stack->stack = stack->inlineStack;
+        stack->size = sizeof(hand->stateStackInline);
+    }
+}
+
+/* apply the memory policies as a parse call returns */
+static yajl_status
+yajl_check_memory(yajl_handle hand, yajl_status status)
+{
+    if (hand->trimSize) yajl_trim(hand);
+    if (hand->maxMemory && status == yajl_status_ok &&
+        yajl_memory_used(hand) > hand->maxMemory)
+    {
+        yajl_bs_set(hand->stateStack, yajl_state_parse_error);
+        hand->parseError = "memory limit exceeded";
+        return yajl_status_memory_limit;
+    }
+    return status;
+}
+
 yajl_status
 yajl_parse(yajl_handle hand, const unsigned char * jsonText,
            size_t jsonTextLen)
 {
     yajl_status status;
+#ifndef YAJL_NO_STATS
+    unsigned long long callbackNs = hand->stats.sampledCallbackNs;
+    unsigned long long start = yajl_stats_begin(hand, jsonTextLen);
+#endif
 
-    /* lazy allocation of the lexer */
-    if (hand->lexer == NULL) {
-        hand->lexer = yajl_lex_alloc(&(hand->alloc),
-                                     hand->flags & yajl_allow_comments,
-                                     !(hand->flags & yajl_dont_validate_strings));
-    }
+    YAJL_PROBE2(parse__start, hand, jsonTextLen);
+    yajl_start_lexer(hand);
 
     status = yajl_do_parse(hand, jsonText, jsonTextLen);
+    YAJL_STAT(yajl_stats_end(hand, start, callbackNs));
+    status = yajl_check_memory(hand, status);
+    YAJL_PROBE3(parse__done, hand, hand->bytesConsumed, (int) status);
     return status;
 }
 
@@ -135,19 +307,20 @@ yajl_parse(yajl_handle hand, const unsigned char * jsonText,
 yajl_status
 yajl_complete_parse(yajl_handle hand)
 {
-    /* The lexer is lazy allocated in the first call to parse.  if parse is
+    /* The lexer is set up in the first call to parse.  if parse is
      * never called, then no data was provided to parse at all.  This is a
      * "premature EOF" error unless yajl_allow_partial_values is specified.
-     * allocating the lexer now is the simplest possible way to handle this
+     * setting up the lexer now is the simplest possible way to handle this
      * case while preserving all the other semantics of the parser
      * (multiple values, partial values, etc). */
-    if (hand->lexer == NULL) {
-        hand->lexer = yajl_lex_alloc(&(hand->alloc),
-                                     hand->flags & yajl_allow_comments,
-                                     !(hand->flags & yajl_dont_validate_strings));
-    }
+    yajl_status status;
 
-    return yajl_do_finish(hand);
+    YAJL_PROBE1(complete__start, hand);
+    yajl_start_lexer(hand);
+
+    status = yajl_check_memory(hand, yajl_do_finish(hand));
+    YAJL_PROBE2(complete__done, hand, (int) status);
+    return status;
 }
 
 unsigned char *
@@ -172,4 +345,75 @@ yajl_free_error(yajl_handle hand, unsigned char * str)
     YA_FREE(&(hand->alloc), str);
 }
 
+struct yajl_handle_pool_t {
+    const yajl_callbacks * callbacks;
+    yajl_alloc_funcs alloc;
+    /* idle handles, up to max of them */
+    yajl_handle * handles;
+    unsigned int count;
+    unsigned int max;
+};
+
+yajl_handle_pool
+yajl_handle_pool_alloc(const yajl_callbacks * callbacks,
+                       yajl_alloc_funcs * afs,
+                       unsigned int max)
+{
+    yajl_handle_pool pool;
+    yajl_alloc_funcs afsBuffer;
+
+    if (afs != NULL) {
+        if (afs->malloc == NULL || afs->realloc == NULL || afs->free == NULL)
+        {
+            return NULL;
+        }
+    } else {
+        yajl_set_default_alloc_funcs(&afsBuffer);
+        afs = &afsBuffer;
+    }
+
+    pool = (yajl_handle_pool) YA_MALLOC(afs, sizeof(struct yajl_handle_pool_t));
+    if (!pool) return NULL;
+    memcpy((void *) &(pool->alloc), (void *) afs, sizeof(yajl_alloc_funcs));
+    pool->callbacks = callbacks;
+    pool->count = 0;
+    pool->max = max;
+    pool->handles = NULL;
+    if (max) {
+        pool->handles = (yajl_handle *)
+            YA_MALLOC(afs, max * sizeof(yajl_handle));
+        if (!pool->handles) {
+            YA_FREE(afs, pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void
+yajl_handle_pool_free(yajl_handle_pool pool)
+{
+    while (pool->count) yajl_free(pool->handles[--pool->count]);
+    if (pool->handles) YA_FREE(&(pool->alloc), pool->handles);
+    YA_FREE(&(pool->alloc), pool);
+}
+
+yajl_handle
+yajl_handle_pool_get(yajl_handle_pool pool, void * ctx)
+{
+    yajl_handle hand;
+
+    if (!pool->count) return yajl_alloc(pool->callbacks, &(pool->alloc), ctx);
+    hand = pool->handles[--pool->count];
+    yajl_reset(hand, ctx);
+    return hand;
+}
+
+void
+yajl_handle_pool_put(yajl_handle_pool pool, yajl_handle hand)
+{
+    if (pool->count < pool->max) pool->handles[pool->count++] = hand;
+    else yajl_free(hand);
+}
+
 /* XXX: add utility routines to parse from file */
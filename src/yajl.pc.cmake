@@ -7,3 +7,4 @@ Description: A Portable JSON parsing and serialization library in ANSI C
 Version: ${YAJL_MAJOR}.${YAJL_MINOR}.${YAJL_MICRO}
 Cflags: -I${dollar}{includedir}
 Libs: -L${dollar}{libdir} -lyajl
+Requires.private: ${YAJL_PC_REQUIRES_PRIVATE}
@@ -22,6 +22,7 @@
 
 #include "yajl_alloc.h"
 #include <stdlib.h>
+#include <string.h>
 
 static void * yajl_internal_malloc(void *ctx, size_t sz)
 {
@@ -47,3 +48,93 @@ void yajl_set_default_alloc_funcs(yajl_alloc_funcs * yaf)
     yaf->ctx = NULL;
 }
 
+/* tracked allocations are preceded by their size, padded to the strictest
+ * alignment malloc provides (long double's, 16 bytes on most 64 bit
+ * platforms) so that the memory handed out stays aligned for any type */
+typedef union {
+    size_t size;
+    long double ld;
+    double d;
+    void * p;
+    void (*fp)(void);
+} yajl_mem_header;
+
+static void yajl_mem_grew(yajl_mem_tracker * t, size_t sz)
+{
+    t->stats.bytes += sz;
+    t->stats.totalBytes += sz;
+    if (t->stats.bytes > t->stats.peakBytes) {
+        t->stats.peakBytes = t->stats.bytes;
+    }
+}
+
+static void * yajl_tracked_malloc(void *ctx, size_t sz)
+{
+    yajl_mem_tracker * t = (yajl_mem_tracker *) ctx;
+    yajl_mem_header * h = (yajl_mem_header *)
+        YA_MALLOC(&(t->backing), sizeof(yajl_mem_header) + sz);
+    if (!h) return NULL;
+    h->size = sz;
+    t->stats.allocs++;
+    yajl_mem_grew(t, sz);
+    return h + 1;
+}
+
+static void * yajl_tracked_realloc(void *ctx, void * previous, size_t sz)
+{
+    yajl_mem_tracker * t = (yajl_mem_tracker *) ctx;
+    yajl_mem_header * h;
+    size_t old;
+
+    if (!previous) return yajl_tracked_malloc(ctx, sz);
+    h = (yajl_mem_header *) previous - 1;
+    old = h->size;
+    h = (yajl_mem_header *)
+        YA_REALLOC(&(t->backing), h, sizeof(yajl_mem_header) + sz);
+    if (!h) return NULL;
+    h->size = sz;
+    t->stats.reallocs++;
+    t->stats.bytes -= old;
+    yajl_mem_grew(t, sz);
+    return h + 1;
+}
+
+static void yajl_tracked_free(void *ctx, void * ptr)
+{
+    yajl_mem_tracker * t = (yajl_mem_tracker *) ctx;
+    yajl_mem_header * h;
+
+    if (!ptr) return;
+    h = (yajl_mem_header *) ptr - 1;
+    t->stats.frees++;
+    t->stats.bytes -= h->size;
+    YA_FREE(&(t->backing), h);
+}
+
+void yajl_mem_tracker_init(yajl_mem_tracker * t,
+                           const yajl_alloc_funcs * backing)
+{
+    if (backing) {
+        memcpy((void *) &(t->backing), (const void *) backing,
+               sizeof(yajl_alloc_funcs));
+    } else {
+        yajl_set_default_alloc_funcs(&(t->backing));
+    }
+    memset((void *) &(t->stats), 0, sizeof(yajl_mem_stats));
+    t->funcs.malloc = yajl_tracked_malloc;
+    t->funcs.free = yajl_tracked_free;
+    t->funcs.realloc = yajl_tracked_realloc;
+    t->funcs.ctx = t;
+}
+
+void yajl_mem_tracker_stats(const yajl_alloc_funcs * afs,
+                            yajl_mem_stats * stats)
+{
+    if (afs->malloc == yajl_tracked_malloc) {
+        const yajl_mem_tracker * t = (const yajl_mem_tracker *) afs->ctx;
+        memcpy((void *) stats, (const void *) &(t->stats),
+               sizeof(yajl_mem_stats));
+    } else {
+        memset((void *) stats, 0, sizeof(yajl_mem_stats));
+    }
+}
@@ -31,4 +31,9 @@
 
 void yajl_set_default_alloc_funcs(yajl_alloc_funcs * yaf);
 
+/* copy out the stats of the tracker afs belong to, or zeros if they
+ * aren't a tracker's */
+void yajl_mem_tracker_stats(const yajl_alloc_funcs * afs,
+                            yajl_mem_stats * stats);
+
 #endif
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2007-2011, Lloyd Hilaiel <lloyd@hilaiel.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "api/yajl_arena.h"
+#include "yajl_alloc.h"
+
+#include <string.h>
+
+#define YAJL_ARENA_DEFAULT_BLOCK_SIZE 65536
+
+/* allocations are aligned for any type yajl stores in them */
+#define YAJL_ARENA_ALIGN 8
+#define YAJL_ARENA_ROUND(sz) \
+    (((sz) + YAJL_ARENA_ALIGN - 1) & ~((size_t) YAJL_ARENA_ALIGN - 1))
+
+typedef struct yajl_arena_block_t {
+    struct yajl_arena_block_t * next;
+    /* bytes of data following the header, and how many are handed out */
+    size_t size;
+    size_t used;
+} yajl_arena_block;
+
+#define BLOCK_HDR_SIZE YAJL_ARENA_ROUND(sizeof(yajl_arena_block))
+#define BLOCK_DATA(b) ((unsigned char *) (b) + BLOCK_HDR_SIZE)
+
+/* each allocation is preceded by its size, for realloc to copy */
+#define ALLOC_HDR_SIZE YAJL_ARENA_ROUND(sizeof(size_t))
+#define ALLOC_SIZE(p) (*(size_t *) ((unsigned char *) (p) - ALLOC_HDR_SIZE))
+
+struct yajl_arena_t {
+    /* blocks in order of use.  those after cur are kept for reuse */
+    yajl_arena_block * first;
+    yajl_arena_block * cur;
+    /* the most recent allocation, which ends at cur's used mark and so
+     * can grow, shrink and be freed in place */
+    unsigned char * last;
+    size_t blockSize;
+    yajl_alloc_funcs alloc;
+};
+
+static yajl_arena_block *
+yajl_arena_new_block(yajl_arena a, size_t size)
+{
+    yajl_arena_block * b = (yajl_arena_block *)
+        YA_MALLOC(&(a->alloc), BLOCK_HDR_SIZE + size);
+    if (!b) return NULL;
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+/* move on to a block with room for need bytes, reusing the next kept
+ * block if it is big enough */
+static int
+yajl_arena_next_block(yajl_arena a, size_t need)
+{
+    yajl_arena_block * b = a->cur->next;
+
+    if (!b || b->size < need) {
+        b = yajl_arena_new_block(a, need > a->blockSize ? need : a->blockSize);
+        if (!b) return 0;
+        b->next = a->cur->next;
+        a->cur->next = b;
+    }
+    b->used = 0;
+    a->cur = b;
+    return 1;
+}
+
+static void *
+yajl_arena_malloc(void * ctx, size_t sz)
+{
+    yajl_arena a = (yajl_arena) ctx;
+    size_t need = ALLOC_HDR_SIZE + YAJL_ARENA_ROUND(sz);
+    unsigned char * p;
+
+    if (a->cur->size - a->cur->used < need && !yajl_arena_next_block(a, need))
+    {
+        return NULL;
+    }
+    p = BLOCK_DATA(a->cur) + a->cur->used + ALLOC_HDR_SIZE;
+    a->cur->used += need;
+    ALLOC_SIZE(p) = sz;
+    a->last = p;
+    return p;
+}
+
+static void
+yajl_arena_free_func(void * ctx, void * ptr)
+{
+    yajl_arena a = (yajl_arena) ctx;
+
+    /* only the most recent allocation can be handed back before a reset */
+    if (ptr && ptr == a->last) {
+        a->cur->used = a->last - ALLOC_HDR_SIZE - BLOCK_DATA(a->cur);
+        a->last = NULL;
+    }
+}
+
+static void *
+yajl_arena_realloc(void * ctx, void * ptr, size_t sz)
+{
+    yajl_arena a = (yajl_arena) ctx;
+    size_t old;
+    void * moved;
+
+    if (!ptr) return yajl_arena_malloc(ctx, sz);
+
+    old = ALLOC_SIZE(ptr);
+    if (ptr == a->last) {
+        size_t end = (a->last - BLOCK_DATA(a->cur)) + YAJL_ARENA_ROUND(sz);
+        if (end <= a->cur->size) {
+            a->cur->used = end;
+            ALLOC_SIZE(ptr) = sz;
+            return ptr;
+        }
+    } else if (sz <= old) {
+        ALLOC_SIZE(ptr) = sz;
+        return ptr;
+    }
+
+    moved = yajl_arena_malloc(ctx, sz);
+    if (!moved) return NULL;
+    memcpy(moved, ptr, old < sz ? old : sz);
+    return moved;
+}
+
+yajl_arena
+yajl_arena_alloc(yajl_alloc_funcs * afs, size_t blockSize)
+{
+    yajl_arena a;
+    yajl_alloc_funcs afsBuffer;
+
+    if (afs != NULL) {
+        if (afs->malloc == NULL || afs->realloc == NULL || afs->free == NULL)
+        {
+            return NULL;
+        }
+    } else {
+        yajl_set_default_alloc_funcs(&afsBuffer);
+        afs = &afsBuffer;
+    }
+
+    a = (yajl_arena) YA_MALLOC(afs, sizeof(struct yajl_arena_t));
+    if (!a) return NULL;
+    memcpy((void *) &(a->alloc), (void *) afs, sizeof(yajl_alloc_funcs));
+    a->blockSize = blockSize ? YAJL_ARENA_ROUND(blockSize)
+                             : YAJL_ARENA_DEFAULT_BLOCK_SIZE;
+    a->last = NULL;
+    a->first = a->cur = yajl_arena_new_block(a, a->blockSize);
+    if (!a->first) {
+        YA_FREE(afs, a);
+        return NULL;
+    }
+    return a;
+}
+
+void
+yajl_arena_free(yajl_arena a)
+{
+    while (a->first) {
+        yajl_arena_block * next = a->first->next;
+        YA_FREE(&(a->alloc), a->first);
+        a->first = next;
+    }
+    YA_FREE(&(a->alloc), a);
+}
+
+void
+yajl_arena_get_alloc_funcs(yajl_arena a, yajl_alloc_funcs * afs)
+{
+    afs->malloc = &yajl_arena_malloc;
+    afs->realloc = &yajl_arena_realloc;
+    afs->free = &yajl_arena_free_func;
+    afs->ctx = a;
+}
+
+yajl_arena_mark
+yajl_arena_get_mark(yajl_arena a)
+{
+    yajl_arena_mark mark;
+    mark.block = a->cur;
+    mark.used = a->cur->used;
+    return mark;
+}
+
+void
+yajl_arena_reset(yajl_arena a, const yajl_arena_mark * mark)
+{
+    a->cur = (yajl_arena_block *) mark->block;
+    a->cur->used = mark->used;
+    a->last = NULL;
+}
+
+void
+yajl_arena_clear(yajl_arena a)
+{
+    a->cur = a->first;
+    a->cur->used = 0;
+    a->last = NULL;
+}
@@ -22,13 +22,6 @@
 
 #define YAJL_BUF_INIT_SIZE 2048
 
-struct yajl_buf_t {
-    size_t len;
-    size_t used;
-    unsigned char * data;
-    yajl_alloc_funcs * alloc;
-};
-
 static
 void yajl_buf_ensure_available(yajl_buf buf, size_t want)
 {
@@ -48,7 +41,15 @@ void yajl_buf_ensure_available(yajl_buf buf, size_t want)
     while (want >= (need - buf->used)) need <<= 1;
 
     if (need != buf->len) {
-        buf->data = (unsigned char *) YA_REALLOC(buf->alloc, buf->data, need);
+        if (buf->data == buf->inlineData) {
+            unsigned char * data =
+                (unsigned char *) YA_MALLOC(buf->alloc, need);
+            memcpy(data, buf->data, buf->used + 1);
+            buf->data = data;
+        } else {
+            buf->data =
+                (unsigned char *) YA_REALLOC(buf->alloc, buf->data, need);
+        }
         buf->len = need;
     }
 }
@@ -56,18 +57,36 @@ void yajl_buf_ensure_available(yajl_buf buf, size_t want)
 yajl_buf yajl_buf_alloc(yajl_alloc_funcs * alloc)
 {
     yajl_buf b = YA_MALLOC(alloc, sizeof(struct yajl_buf_t));
-    memset((void *) b, 0, sizeof(struct yajl_buf_t));
-    b->alloc = alloc;
+    yajl_buf_init(b, alloc, NULL, 0);
     return b;
 }
 
 void yajl_buf_free(yajl_buf buf)
 {
     assert(buf != NULL);
-    if (buf->data) YA_FREE(buf->alloc, buf->data);
+    yajl_buf_release(buf);
     YA_FREE(buf->alloc, buf);
 }
 
+void yajl_buf_init(yajl_buf buf, yajl_alloc_funcs * alloc,
+                   unsigned char * storage, size_t len)
+{
+    memset((void *) buf, 0, sizeof(struct yajl_buf_t));
+    buf->alloc = alloc;
+    if (storage) {
+        buf->data = buf->inlineData = storage;
+        buf->len = buf->inlineLen = len;
+        buf->data[0] = 0;
+    }
+}
+
+void yajl_buf_release(yajl_buf buf)
+{
+    if (buf->data && buf->data != buf->inlineData) {
+        YA_FREE(buf->alloc, buf->data);
+    }
+}
+
 void yajl_buf_append(yajl_buf buf, const void * data, size_t len)
 {
     yajl_buf_ensure_available(buf, len);
@@ -79,6 +98,42 @@ void yajl_buf_append(yajl_buf buf, const void * data, size_t len)
     }
 }
 
+unsigned char * yajl_buf_reserve(yajl_buf buf, size_t len)
+{
+    yajl_buf_ensure_available(buf, len);
+    return buf->data + buf->used;
+}
+
+void yajl_buf_commit(yajl_buf buf, size_t len)
+{
+    assert(buf->used + len < buf->len);
+    buf->used += len;
+    buf->data[buf->used] = 0;
+}
+
+size_t yajl_buf_allocated(yajl_buf buf)
+{
+    return (buf->data && buf->data != buf->inlineData) ? buf->len : 0;
+}
+
+void yajl_buf_trim(yajl_buf buf, size_t len)
+{
+    if (!buf->data || buf->data == buf->inlineData ||
+        buf->len <= len || buf->used >= len)
+    {
+        return;
+    }
+    if (buf->used < buf->inlineLen) {
+        memcpy(buf->inlineData, buf->data, buf->used + 1);
+        YA_FREE(buf->alloc, buf->data);
+        buf->data = buf->inlineData;
+        buf->len = buf->inlineLen;
+    } else {
+        buf->data = (unsigned char *) YA_REALLOC(buf->alloc, buf->data, len);
+        buf->len = len;
+    }
+}
+
 void yajl_buf_clear(yajl_buf buf)
 {
     buf->used = 0;
@@ -33,15 +33,52 @@
  */
 typedef struct yajl_buf_t * yajl_buf;
 
+/* the buffer is exposed so that it may be embedded in other structures,
+ * see yajl_buf_init.  access it with yajl_buf_XXX routines */
+struct yajl_buf_t {
+    size_t len;
+    size_t used;
+    unsigned char * data;
+    /* storage provided at initialization, which is not freed */
+    unsigned char * inlineData;
+    size_t inlineLen;
+    yajl_alloc_funcs * alloc;
+};
+
 /* allocate a new buffer */
 yajl_buf yajl_buf_alloc(yajl_alloc_funcs * alloc);
 
 /* free the buffer */
 void yajl_buf_free(yajl_buf buf);
 
+/* initialize a buffer embedded in some other structure.  the buffer
+ * starts out in the len bytes of storage, which may be NULL, and moves to
+ * allocated memory if it outgrows it */
+void yajl_buf_init(yajl_buf buf, yajl_alloc_funcs * alloc,
+                   unsigned char * storage, size_t len);
+
+/* free the memory an initialized buffer has allocated */
+void yajl_buf_release(yajl_buf buf);
+
 /* append a number of bytes to the buffer */
 void yajl_buf_append(yajl_buf buf, const void * data, size_t len);
 
+/* get space for len more bytes at the end of the buffer, to be filled
+ * by the caller and then accounted for with yajl_buf_commit.  the space
+ * is good until the next call which adds to the buffer */
+unsigned char * yajl_buf_reserve(yajl_buf buf, size_t len);
+
+/* add len bytes written into reserved space to the buffer */
+void yajl_buf_commit(yajl_buf buf, size_t len);
+
+/* the number of bytes the buffer has allocated, outside of inline
+ * storage */
+size_t yajl_buf_allocated(yajl_buf buf);
+
+/* shrink the buffer's allocation to len bytes, or back to its inline
+ * storage, if it holds less than that */
+void yajl_buf_trim(yajl_buf buf, size_t len);
+
 /* empty the buffer */
 void yajl_buf_clear(yajl_buf buf);
 
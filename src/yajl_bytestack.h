@@ -31,6 +31,8 @@ typedef struct yajl_bytestack_t
     unsigned char * stack;
     size_t size;
     size_t used;
+    /* storage the stack starts out in, which is not freed, or NULL */
+    unsigned char * inlineStack;
     yajl_alloc_funcs * yaf;
 } yajl_bytestack;
 
@@ -39,13 +41,27 @@ typedef struct yajl_bytestack_t
         (obs).stack = NULL;                     \
         (obs).size = 0;                         \
         (obs).used = 0;                         \
+        (obs).inlineStack = NULL;               \
         (obs).yaf = (_yaf);                     \
     }                                           \
 
+/* initialize a bytestack which starts out in _size bytes of storage,
+ * moving to allocated memory if it outgrows it */
+#define yajl_bs_init_inline(obs, _yaf, _storage, _size) { \
+        (obs).stack = (_storage);               \
+        (obs).size = (_size);                   \
+        (obs).used = 0;                         \
+        (obs).inlineStack = (_storage);         \
+        (obs).yaf = (_yaf);                     \
+    }                                           \
 
-/* initialize a bytestack */
+/* free a bytestack */
 #define yajl_bs_free(obs)                 \
-    if ((obs).stack) (obs).yaf->free((obs).yaf->ctx, (obs).stack);
+    if ((obs).stack && (obs).stack != (obs).inlineStack) \
+        (obs).yaf->free((obs).yaf->ctx, (obs).stack);
+
+/* empty a bytestack, keeping its memory */
+#define yajl_bs_clear(obs) { (obs).used = 0; }
 
 #define yajl_bs_current(obs)               \
     (assert((obs).used > 0), (obs).stack[(obs).used - 1])
@@ -53,8 +69,13 @@ typedef struct yajl_bytestack_t
 #define yajl_bs_push(obs, byte) {                       \
     if (((obs).size - (obs).used) == 0) {               \
         (obs).size += YAJL_BS_INC;                      \
-        (obs).stack = (obs).yaf->realloc((obs).yaf->ctx,\
-                                         (void *) (obs).stack, (obs).size);\
+        if ((obs).inlineStack && (obs).stack == (obs).inlineStack) { \
+            (obs).stack = (obs).yaf->malloc((obs).yaf->ctx, (obs).size);\
+            memcpy((obs).stack, (obs).inlineStack, (obs).used); \
+        } else {                                        \
+            (obs).stack = (obs).yaf->realloc((obs).yaf->ctx,\
+                                             (void *) (obs).stack, (obs).size);\
+        }                                               \
     }                                                   \
     (obs).stack[((obs).used)++] = (byte);               \
 }
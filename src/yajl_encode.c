@@ -75,146 +75,198 @@ yajl_string_encode(const yajl_print_t print,
     print(ctx, (const char *) (str + beg), end - beg);
 }
 
-static void hexToDigit(unsigned int * val, const unsigned char * hex)
+/* the value of each hex digit.  the lexer only lets through unicode escapes
+ * followed by four hex digits, so other entries are never consulted */
+static const unsigned char hexValue[256] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  0,  0,  0,  0,  0,  0,
+     0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+};
+
+static unsigned int hexToDigits(const unsigned char * hex)
 {
-    unsigned int i;
-    for (i=0;i<4;i++) {
-        unsigned char c = hex[i];
-        if (c >= 'A') c = (c & ~0x20) - 7;
-        c -= '0';
-        assert(!(c & 0xF0));
-        *val = (*val << 4) | c;
-    }
+    return ((unsigned int) hexValue[hex[0]] << 12) |
+           ((unsigned int) hexValue[hex[1]] << 8) |
+           ((unsigned int) hexValue[hex[2]] << 4) |
+           (unsigned int) hexValue[hex[3]];
 }
 
-static void Utf32toUtf8(unsigned int codepoint, char * utf8Buf) 
+/* write codepoint as utf8, returning the number of bytes written */
+static size_t Utf32toUtf8(unsigned int codepoint, unsigned char * out)
 {
     if (codepoint < 0x80) {
-        utf8Buf[0] = (char) codepoint;
-        utf8Buf[1] = 0;
+        out[0] = (unsigned char) codepoint;
+        return 1;
     } else if (codepoint < 0x0800) {
-        utf8Buf[0] = (char) ((codepoint >> 6) | 0xC0);
-        utf8Buf[1] = (char) ((codepoint & 0x3F) | 0x80);
-        utf8Buf[2] = 0;
+        out[0] = (unsigned char) ((codepoint >> 6) | 0xC0);
+        out[1] = (unsigned char) ((codepoint & 0x3F) | 0x80);
+        return 2;
     } else if (codepoint < 0x10000) {
-        utf8Buf[0] = (char) ((codepoint >> 12) | 0xE0);
-        utf8Buf[1] = (char) (((codepoint >> 6) & 0x3F) | 0x80);
-        utf8Buf[2] = (char) ((codepoint & 0x3F) | 0x80);
-        utf8Buf[3] = 0;
-    } else if (codepoint < 0x200000) {
-        utf8Buf[0] =(char)((codepoint >> 18) | 0xF0);
-        utf8Buf[1] =(char)(((codepoint >> 12) & 0x3F) | 0x80);
-        utf8Buf[2] =(char)(((codepoint >> 6) & 0x3F) | 0x80);
-        utf8Buf[3] =(char)((codepoint & 0x3F) | 0x80);
-        utf8Buf[4] = 0;
-    } else {
-        utf8Buf[0] = '?';
-        utf8Buf[1] = 0;
+        out[0] = (unsigned char) ((codepoint >> 12) | 0xE0);
+        out[1] = (unsigned char) (((codepoint >> 6) & 0x3F) | 0x80);
+        out[2] = (unsigned char) ((codepoint & 0x3F) | 0x80);
+        return 3;
     }
+    out[0] = (unsigned char) ((codepoint >> 18) | 0xF0);
+    out[1] = (unsigned char) (((codepoint >> 12) & 0x3F) | 0x80);
+    out[2] = (unsigned char) (((codepoint >> 6) & 0x3F) | 0x80);
+    out[3] = (unsigned char) ((codepoint & 0x3F) | 0x80);
+    return 4;
 }
 
-void yajl_string_decode(yajl_buf buf, const unsigned char * str,
-                        size_t len)
+/* decode the unicode escape whose hex digits start at *str, along with the low
+ * surrogate escape following a high surrogate, advancing *str past them.
+ * lone surrogates decode to '?' */
+static unsigned int decodeUnicodeEscape(const unsigned char ** str,
+                                        const unsigned char * end)
 {
-    size_t beg = 0;
-    size_t end = 0;    
-
-    while (end < len) {
-        if (str[end] == '\\') {
-            char utf8Buf[5];
-            const char * unescaped = "?";
-            yajl_buf_append(buf, str + beg, end - beg);
-            switch (str[++end]) {
-                case 'r': unescaped = "\r"; break;
-                case 'n': unescaped = "\n"; break;
-                case '\\': unescaped = "\\"; break;
-                case '/': unescaped = "/"; break;
-                case '"': unescaped = "\""; break;
-                case 'f': unescaped = "\f"; break;
-                case 'b': unescaped = "\b"; break;
-                case 't': unescaped = "\t"; break;
-                case 'u': {
-                    unsigned int codepoint = 0;
-                    hexToDigit(&codepoint, str + ++end);
-                    end+=3;
-                    /* check if this is a surrogate */
-                    if ((codepoint & 0xFC00) == 0xD800) {
-                        end++;
-                        if (str[end] == '\\' && str[end + 1] == 'u') {
-                            unsigned int surrogate = 0;
-                            hexToDigit(&surrogate, str + end + 2);
-                            codepoint =
-                                (((codepoint & 0x3F) << 10) | 
-                                 ((((codepoint >> 6) & 0xF) + 1) << 16) | 
-                                 (surrogate & 0x3FF));
-                            end += 5;
-                        } else {
-                            unescaped = "?";
-                            break;
-                        }
-                    }
-                    
-                    Utf32toUtf8(codepoint, utf8Buf);
-                    unescaped = utf8Buf;
-
-                    if (codepoint == 0) {
-                        yajl_buf_append(buf, unescaped, 1);
-                        beg = ++end;
-                        continue;
-                    }
-
-                    break;
-                }
-                default:
-                    assert("this should never happen" == NULL);
-            }
-            yajl_buf_append(buf, unescaped, (unsigned int)strlen(unescaped));
-            beg = ++end;
+    const unsigned char * s = *str;
+    unsigned int codepoint = hexToDigits(s);
+    s += 4;
+    if ((codepoint & 0xFC00) == 0xD800) {
+        /* a high surrogate is only meaningful followed by a low one,
+         * which the lexer has checked the hex of if it is escaped */
+        unsigned int low = 0;
+        if (end - s >= 6 && s[0] == '\\' && s[1] == 'u') {
+            low = hexToDigits(s + 2);
+        }
+        if ((low & 0xFC00) == 0xDC00) {
+            codepoint = 0x10000 + ((codepoint & 0x3FF) << 10) +
+                        (low & 0x3FF);
+            s += 6;
         } else {
-            end++;
+            codepoint = '?';
+        }
+    } else if ((codepoint & 0xFC00) == 0xDC00) {
+        codepoint = '?';
+    }
+    *str = s;
+    return codepoint;
+}
+
+size_t yajl_string_decode_raw(unsigned char * out, const unsigned char * str,
+                              size_t len)
+{
+    const unsigned char * end = str + len;
+    unsigned char * o = out;
+
+    while (str < end) {
+        /* copy everything up to the next backslash in one go */
+        const unsigned char * esc =
+            (const unsigned char *) memchr(str, '\\', end - str);
+        size_t run = (esc ? esc : end) - str;
+        memcpy(o, str, run);
+        o += run;
+        if (!esc) break;
+        str = esc + 2;
+
+        switch (esc[1]) {
+            case 'r': *o++ = '\r'; break;
+            case 'n': *o++ = '\n'; break;
+            case '\\': *o++ = '\\'; break;
+            case '/': *o++ = '/'; break;
+            case '"': *o++ = '"'; break;
+            case 'f': *o++ = '\f'; break;
+            case 'b': *o++ = '\b'; break;
+            case 't': *o++ = '\t'; break;
+            case 'u':
+                o += Utf32toUtf8(decodeUnicodeEscape(&str, end), o);
+                break;
+            default:
+                assert("this should never happen" == NULL);
+        }
+    }
+
+    return o - out;
+}
+
+size_t yajl_string_decoded_length(const unsigned char * str, size_t len)
+{
+    const unsigned char * end = str + len;
+    size_t decodedLen = len;
+
+    while ((str = (const unsigned char *) memchr(str, '\\', end - str))) {
+        const unsigned char * esc = str;
+        unsigned int codepoint;
+
+        str += 2;
+        if (esc[1] != 'u') {
+            decodedLen--;
+            continue;
         }
+        codepoint = decodeUnicodeEscape(&str, end);
+        decodedLen -= (str - esc);
+        decodedLen += (codepoint < 0x80) ? 1 : (codepoint < 0x800) ? 2 :
+                      (codepoint < 0x10000) ? 3 : 4;
     }
-    yajl_buf_append(buf, str + beg, end - beg);
+
+    return decodedLen;
 }
 
-#define ADV_PTR s++; if (!(len--)) return 0;
+void yajl_string_decode(yajl_buf buf, const unsigned char * str,
+                        size_t len)
+{
+    /* decoded output is never longer than its input */
+    unsigned char * out = yajl_buf_reserve(buf, len);
+    yajl_buf_commit(buf, yajl_string_decode_raw(out, str, len));
+}
 
 int yajl_string_validate_utf8(const unsigned char * s, size_t len)
 {
+    unsigned int pending = 0;
+
     if (!len) return 1;
     if (!s) return 0;
-    
+
+    return yajl_string_validate_utf8_partial(s, len, &pending) && !pending;
+}
+
+int yajl_string_validate_utf8_partial(const unsigned char * s, size_t len,
+                                      unsigned int * pending)
+{
+    unsigned int need = *pending;
+
     while (len--) {
+        if (need) {
+            /* continuation of a sequence begun earlier */
+            if (!((*s >> 6) == 0x2)) return 0;
+            need--;
+        }
         /* single byte */
-        if (*s <= 0x7f) {
+        else if (*s <= 0x7f) {
             /* noop */
         }
-        /* two byte */ 
+        /* two byte */
         else if ((*s >> 5) == 0x6) {
-            ADV_PTR;
-            if (!((*s >> 6) == 0x2)) return 0;
+            need = 1;
         }
         /* three byte */
         else if ((*s >> 4) == 0x0e) {
-            ADV_PTR;
-            if (!((*s >> 6) == 0x2)) return 0;
-            ADV_PTR;
-            if (!((*s >> 6) == 0x2)) return 0;
+            need = 2;
         }
-        /* four byte */        
+        /* four byte */
         else if ((*s >> 3) == 0x1e) {
-            ADV_PTR;
-            if (!((*s >> 6) == 0x2)) return 0;
-            ADV_PTR;
-            if (!((*s >> 6) == 0x2)) return 0;
-            ADV_PTR;
-            if (!((*s >> 6) == 0x2)) return 0;
+            need = 3;
         } else {
             return 0;
         }
-        
+
         s++;
     }
-    
+
+    *pending = need;
     return 1;
 }
@@ -29,6 +29,22 @@ void yajl_string_encode(const yajl_print_t printer,
 void yajl_string_decode(yajl_buf buf, const unsigned char * str,
                         size_t length);
 
+/* decode a string's escapes into out, which must have room for length
+ * bytes: decoding never makes a string longer.  returns the number of
+ * bytes written.  lone surrogates decode to '?' */
+size_t yajl_string_decode_raw(unsigned char * out, const unsigned char * str,
+                              size_t length);
+
+/* the exact number of bytes a string decodes to */
+size_t yajl_string_decoded_length(const unsigned char * str, size_t length);
+
 int yajl_string_validate_utf8(const unsigned char * s, size_t len);
 
+/* validate a piece of a utf8 string which may begin or end in the middle
+ * of a multi-byte sequence.  pending holds the number of continuation
+ * bytes still expected from the previous piece (zero to start) and is
+ * updated for the next one. */
+int yajl_string_validate_utf8_partial(const unsigned char * s, size_t len,
+                                      unsigned int * pending);
+
 #endif
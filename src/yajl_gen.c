@@ -17,12 +17,16 @@
 #include "api/yajl_gen.h"
 #include "yajl_buf.h"
 #include "yajl_encode.h"
+#include "yajl_bytestack.h"
+#include "yajl_gz.h"
+#include "yajl_trace.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
 #include <stdarg.h>
+#include <assert.h>
 
 typedef enum {
     yajl_gen_start,
@@ -35,18 +39,224 @@ typedef enum {
     yajl_gen_error
 } yajl_gen_state;
 
+/* a caller-provided output buffer of fixed size.  see
+ * yajl_gen_output_buffer */
+typedef struct {
+    unsigned char * data;
+    size_t len;
+    size_t used;
+    /* set when a write didn't fit, cleared when the call is undone */
+    unsigned int overflow;
+} yajl_gen_fixed_buf;
+
+/* scatter-gather output.  see yajl_gen_iovec_output */
+#define YAJL_GEN_IOV_DEFAULT_THRESHOLD 256
+#define YAJL_GEN_IOV_MIN_THRESHOLD 16
+
+typedef struct {
+    /* copied bytes, referenced by segments with a NULL base */
+    yajl_buf side;
+    /* segments in output order.  bytes of segments with a NULL base are
+     * found consecutively in the side buffer */
+    yajl_gen_iovec * segs;
+    size_t numSegs;
+    size_t segsAlloc;
+    /* the list handed to the client, with side buffer pointers resolved */
+    yajl_gen_iovec * iov;
+    size_t iovAlloc;
+    /* client spans at least this long are referenced, not copied */
+    size_t threshold;
+    yajl_alloc_funcs * alloc;
+} yajl_gen_iov_sink;
+
 struct yajl_gen_t
 {
     unsigned int flags;
     unsigned int depth;
+    /* for fragment generators, the depth of the enclosing container */
+    unsigned int baseDepth;
+    /* maximum nesting depth, zero for none */
+    unsigned int maxDepth;
     const char * indentString;
-    yajl_gen_state state[YAJL_MAX_DEPTH];
+    /* a stack of states, one for each depth from baseDepth to depth.
+     * access with yajl_bs_XXX routines */
+    yajl_bytestack stateStack;
     yajl_print_t print;
+    /* prints bytes that live in client memory, and may reference rather
+     * than copy them.  the same as print except with iovec output */
+    yajl_print_t printRef;
     void * ctx; /* yajl_buf */
+    /* non-zero while a string started with yajl_gen_string_begin is open */
+    unsigned int inString;
+    /* utf8 continuation bytes still expected by the open string */
+    unsigned int utf8Pending;
+    /* output sink used when yajl_gen_output_buffer is set */
+    yajl_gen_fixed_buf fixed;
+    /* compressor in front of the output sink, when gzip_output is set.
+     * print and ctx then lead to it, and it leads to the sink */
+    yajl_gz gz;
     /* memory allocation routines */
     yajl_alloc_funcs alloc;
 };
 
+/* the generator's state before a call produces output, so that a call
+ * which overflows a fixed output buffer can be undone */
+typedef struct {
+    size_t used;
+    unsigned int depth;
+    size_t stateUsed;
+    yajl_gen_state top;
+    yajl_gen_state below;
+    unsigned int inString;
+    unsigned int utf8Pending;
+} yajl_gen_snapshot;
+
+static void
+yajl_gen_fixed_append(void * ctx, const char * str, size_t len)
+{
+    yajl_gen_fixed_buf * fb = (yajl_gen_fixed_buf *) ctx;
+
+    if (fb->overflow) return;
+    if (len > fb->len - fb->used) {
+        fb->overflow = 1;
+        return;
+    }
+    memcpy(fb->data + fb->used, str, len);
+    fb->used += len;
+}
+
+static void
+yajl_gen_save(yajl_gen g, yajl_gen_snapshot * snap)
+{
+    snap->used = g->fixed.used;
+    snap->depth = g->depth;
+    snap->stateUsed = g->stateStack.used;
+    snap->top = yajl_bs_current(g->stateStack);
+    snap->below = (g->stateStack.used > 1) ?
+        g->stateStack.stack[g->stateStack.used - 2] : yajl_gen_start;
+    snap->inString = g->inString;
+    snap->utf8Pending = g->utf8Pending;
+}
+
+static yajl_gen_status
+yajl_gen_restore(yajl_gen g, const yajl_gen_snapshot * snap)
+{
+    g->fixed.used = snap->used;
+    g->fixed.overflow = 0;
+    g->depth = snap->depth;
+    /* a call pushes or pops at most one state */
+    g->stateStack.used = snap->stateUsed;
+    yajl_bs_set(g->stateStack, snap->top);
+    if (g->stateStack.used > 1) {
+        g->stateStack.stack[g->stateStack.used - 2] = snap->below;
+    }
+    g->inString = snap->inString;
+    g->utf8Pending = snap->utf8Pending;
+    return yajl_gen_buffer_full;
+}
+
+static yajl_gen_iovec *
+yajl_gen_iov_add_seg(yajl_gen_iov_sink * sink)
+{
+    if (sink->numSegs == sink->segsAlloc) {
+        size_t n = sink->segsAlloc ? sink->segsAlloc * 2 : 64;
+        sink->segs = (yajl_gen_iovec *)
+            YA_REALLOC(sink->alloc, sink->segs, n * sizeof(yajl_gen_iovec));
+        sink->segsAlloc = n;
+    }
+    return sink->segs + sink->numSegs++;
+}
+
+static void
+yajl_gen_iov_copy(void * ctx, const char * str, size_t len)
+{
+    yajl_gen_iov_sink * sink = (yajl_gen_iov_sink *) ctx;
+    yajl_gen_iovec * seg;
+
+    if (!len) return;
+    yajl_buf_append(sink->side, str, len);
+
+    /* extend the previous segment if it is in the side buffer too */
+    if (sink->numSegs && sink->segs[sink->numSegs - 1].iov_base == NULL) {
+        sink->segs[sink->numSegs - 1].iov_len += len;
+        return;
+    }
+    seg = yajl_gen_iov_add_seg(sink);
+    seg->iov_base = NULL;
+    seg->iov_len = len;
+}
+
+static void
+yajl_gen_iov_ref(void * ctx, const char * str, size_t len)
+{
+    yajl_gen_iov_sink * sink = (yajl_gen_iov_sink *) ctx;
+    yajl_gen_iovec * seg;
+
+    if (len < sink->threshold) {
+        yajl_gen_iov_copy(ctx, str, len);
+        return;
+    }
+    seg = yajl_gen_iov_add_seg(sink);
+    seg->iov_base = str;
+    seg->iov_len = len;
+}
+
+static yajl_gen_iov_sink *
+yajl_gen_iov_alloc(yajl_alloc_funcs * alloc, size_t threshold)
+{
+    yajl_gen_iov_sink * sink =
+        (yajl_gen_iov_sink *) YA_MALLOC(alloc, sizeof(yajl_gen_iov_sink));
+    memset((void *) sink, 0, sizeof(yajl_gen_iov_sink));
+    sink->alloc = alloc;
+    sink->side = yajl_buf_alloc(alloc);
+    if (threshold == 0) threshold = YAJL_GEN_IOV_DEFAULT_THRESHOLD;
+    if (threshold < YAJL_GEN_IOV_MIN_THRESHOLD) {
+        threshold = YAJL_GEN_IOV_MIN_THRESHOLD;
+    }
+    sink->threshold = threshold;
+    return sink;
+}
+
+static void
+yajl_gen_iov_free(yajl_gen_iov_sink * sink)
+{
+    yajl_buf_free(sink->side);
+    if (sink->segs) YA_FREE(sink->alloc, sink->segs);
+    if (sink->iov) YA_FREE(sink->alloc, sink->iov);
+    YA_FREE(sink->alloc, sink);
+}
+
+/* get the sink output ends up in, behind the compressor if there is one */
+static yajl_print_t
+yajl_gen_sink(yajl_gen g, void ** ctx)
+{
+    yajl_print_t print = g->print;
+    *ctx = g->ctx;
+    if (g->gz) yajl_gz_sink(g->gz, &print, ctx);
+    return print;
+}
+
+/* free the output sink's resources when switching to another sink */
+static void
+yajl_gen_release_sink(yajl_gen g)
+{
+    void * ctx;
+    yajl_print_t print = yajl_gen_sink(g, &ctx);
+
+    if (g->gz) {
+        yajl_gz_free(g->gz);
+        g->gz = NULL;
+    }
+    if (print == (yajl_print_t)&yajl_buf_append) {
+        yajl_buf_free((yajl_buf)ctx);
+    } else if (print == &yajl_gen_iov_copy) {
+        yajl_gen_iov_free((yajl_gen_iov_sink *) ctx);
+    }
+    g->print = NULL;
+    g->printRef = NULL;
+    g->ctx = NULL;
+}
+
 int
 yajl_gen_config(yajl_gen g, yajl_gen_option opt, ...)
 {
@@ -61,6 +271,9 @@ yajl_gen_config(yajl_gen g, yajl_gen_option opt, ...)
             if (va_arg(ap, int)) g->flags |= opt;
             else g->flags &= ~opt;
             break;
+        case yajl_gen_max_depth:
+            g->maxDepth = va_arg(ap, unsigned int);
+            break;
         case yajl_gen_indent_string: {
             const char *indent = va_arg(ap, const char *);
             g->indentString = indent;
@@ -79,10 +292,47 @@ yajl_gen_config(yajl_gen g, yajl_gen_option opt, ...)
             break;
         }
         case yajl_gen_print_callback:
-            yajl_buf_free(g->ctx);
+            yajl_gen_release_sink(g);
             g->print = va_arg(ap, const yajl_print_t);
+            g->printRef = g->print;
             g->ctx = va_arg(ap, void *);
             break;
+        case yajl_gen_output_buffer:
+            yajl_gen_release_sink(g);
+            g->fixed.data = va_arg(ap, unsigned char *);
+            g->fixed.len = va_arg(ap, size_t);
+            g->fixed.used = 0;
+            g->fixed.overflow = 0;
+            g->print = &yajl_gen_fixed_append;
+            g->printRef = g->print;
+            g->ctx = &(g->fixed);
+            break;
+        case yajl_gen_iovec_output:
+            yajl_gen_release_sink(g);
+            g->ctx = yajl_gen_iov_alloc(&(g->alloc), va_arg(ap, size_t));
+            g->print = &yajl_gen_iov_copy;
+            g->printRef = &yajl_gen_iov_ref;
+            break;
+        case yajl_gen_gzip_output: {
+            int level = va_arg(ap, int);
+            /* fixed and iovec output can't hold compressed data, which
+             * can't be undone or refer to client memory */
+            if (g->gz || g->print == &yajl_gen_fixed_append ||
+                g->print == &yajl_gen_iov_copy)
+            {
+                rv = 0;
+                break;
+            }
+            g->gz = yajl_gz_alloc(&(g->alloc), level, g->print, g->ctx);
+            if (!g->gz) {
+                rv = 0;
+                break;
+            }
+            g->print = &yajl_gz_print;
+            g->printRef = g->print;
+            g->ctx = g->gz;
+            break;
+        }
         default:
             rv = 0;
     }
@@ -119,8 +369,33 @@ yajl_gen_alloc(const yajl_alloc_funcs * afs)
     memcpy((void *) &(g->alloc), (void *) afs, sizeof(yajl_alloc_funcs));
 
     g->print = (yajl_print_t)&yajl_buf_append;
+    g->printRef = g->print;
     g->ctx = yajl_buf_alloc(&(g->alloc));
     g->indentString = "    ";
+    g->maxDepth = YAJL_MAX_DEPTH;
+    yajl_bs_init(g->stateStack, &(g->alloc));
+    yajl_bs_push(g->stateStack, yajl_gen_start);
+
+    return g;
+}
+
+yajl_gen
+yajl_gen_alloc_fragment(const yajl_alloc_funcs * afs,
+                        yajl_gen_fragment_context context,
+                        unsigned int depth)
+{
+    yajl_gen g;
+
+    if (depth == 0) return NULL;
+
+    g = yajl_gen_alloc(afs);
+    if (!g) return NULL;
+
+    /* states below the enclosing container are never consulted, so the
+     * stack starts at baseDepth */
+    g->depth = g->baseDepth = depth;
+    yajl_bs_set(g->stateStack, (context == yajl_gen_fragment_object) ?
+                yajl_gen_map_start : yajl_gen_array_start);
 
     return g;
 }
@@ -128,23 +403,30 @@ yajl_gen_alloc(const yajl_alloc_funcs * afs)
 void
 yajl_gen_free(yajl_gen g)
 {
-    if (g->print == (yajl_print_t)&yajl_buf_append) yajl_buf_free((yajl_buf)g->ctx);
+    yajl_gen_release_sink(g);
+    yajl_bs_free(g->stateStack);
     YA_FREE(&(g->alloc), g);
 }
 
+void
+yajl_gen_get_mem_stats(yajl_gen g, yajl_mem_stats * stats)
+{
+    yajl_mem_tracker_stats(&(g->alloc), stats);
+}
+
 #define INSERT_SEP \
-    if (g->state[g->depth] == yajl_gen_map_key ||               \
-        g->state[g->depth] == yajl_gen_in_array) {              \
+    if (yajl_bs_current(g->stateStack) == yajl_gen_map_key ||               \
+        yajl_bs_current(g->stateStack) == yajl_gen_in_array) {              \
         g->print(g->ctx, ",", 1);                               \
         if ((g->flags & yajl_gen_beautify)) g->print(g->ctx, "\n", 1);               \
-    } else if (g->state[g->depth] == yajl_gen_map_val) {        \
+    } else if (yajl_bs_current(g->stateStack) == yajl_gen_map_val) {        \
         g->print(g->ctx, ":", 1);                               \
         if ((g->flags & yajl_gen_beautify)) g->print(g->ctx, " ", 1);                \
    } 
 
 #define INSERT_WHITESPACE                                               \
     if ((g->flags & yajl_gen_beautify)) {                                                    \
-        if (g->state[g->depth] != yajl_gen_map_val) {                   \
+        if (yajl_bs_current(g->stateStack) != yajl_gen_map_val) {                   \
             unsigned int _i;                                            \
             for (_i=0;_i<g->depth;_i++)                                 \
                 g->print(g->ctx,                                        \
@@ -154,58 +436,79 @@ yajl_gen_free(yajl_gen g)
     }
 
 #define ENSURE_NOT_KEY \
-    if (g->state[g->depth] == yajl_gen_map_key ||       \
-        g->state[g->depth] == yajl_gen_map_start)  {    \
+    if (yajl_bs_current(g->stateStack) == yajl_gen_map_key ||       \
+        yajl_bs_current(g->stateStack) == yajl_gen_map_start)  {    \
         return yajl_gen_keys_must_be_strings;           \
     }                                                   \
 
 /* check that we're not complete, or in error state.  in a valid state
  * to be generating */
 #define ENSURE_VALID_STATE \
-    if (g->state[g->depth] == yajl_gen_error) {   \
+    if (g->inString) {                                      \
+        return yajl_gen_string_in_progress;                 \
+    } else if (yajl_bs_current(g->stateStack) == yajl_gen_error) {   \
         return yajl_gen_in_error_state;\
-    } else if (g->state[g->depth] == yajl_gen_complete) {   \
+    } else if (yajl_bs_current(g->stateStack) == yajl_gen_complete) {   \
         return yajl_gen_generation_complete;                \
     }
 
-#define INCREMENT_DEPTH \
-    if (++(g->depth) >= YAJL_MAX_DEPTH) return yajl_max_depth_exceeded;
+#define INCREMENT_DEPTH(st) \
+    if (g->maxDepth && g->depth + 1 >= g->maxDepth) return yajl_max_depth_exceeded; \
+    g->depth++;                                     \
+    yajl_bs_push(g->stateStack, (st));
 
 #define DECREMENT_DEPTH \
-  if (--(g->depth) >= YAJL_MAX_DEPTH) return yajl_gen_error;
+  if (g->baseDepth && g->depth == g->baseDepth) return yajl_gen_fragment_mismatch; \
+  if (g->depth == 0) return yajl_gen_error;        \
+  g->depth--;                                       \
+  yajl_bs_pop(g->stateStack);
 
 #define APPENDED_ATOM \
-    switch (g->state[g->depth]) {                   \
+    switch (yajl_bs_current(g->stateStack)) {                   \
         case yajl_gen_start:                        \
-            g->state[g->depth] = yajl_gen_complete; \
+            yajl_bs_set(g->stateStack, yajl_gen_complete); \
             break;                                  \
         case yajl_gen_map_start:                    \
         case yajl_gen_map_key:                      \
-            g->state[g->depth] = yajl_gen_map_val;  \
+            yajl_bs_set(g->stateStack, yajl_gen_map_val);  \
             break;                                  \
         case yajl_gen_array_start:                  \
-            g->state[g->depth] = yajl_gen_in_array; \
+            yajl_bs_set(g->stateStack, yajl_gen_in_array); \
             break;                                  \
         case yajl_gen_map_val:                      \
-            g->state[g->depth] = yajl_gen_map_key;  \
+            yajl_bs_set(g->stateStack, yajl_gen_map_key);  \
             break;                                  \
         default:                                    \
             break;                                  \
     }                                               \
 
+/* remember where output began, and undo the call if it overflowed a
+ * fixed output buffer.  BEGIN_OUTPUT must follow all declarations */
+#define BEGIN_OUTPUT \
+    yajl_gen_snapshot _snap; yajl_gen_save(g, &_snap)
+
+#define END_OUTPUT \
+    if (g->fixed.overflow) return yajl_gen_restore(g, &_snap);
+
+/* with compressed output, a complete document also ends the stream */
 #define FINAL_NEWLINE                                        \
-    if ((g->flags & yajl_gen_beautify) && g->state[g->depth] == yajl_gen_complete) \
-        g->print(g->ctx, "\n", 1);
+    if (yajl_bs_current(g->stateStack) == yajl_gen_complete) {  \
+        if (g->flags & yajl_gen_beautify) g->print(g->ctx, "\n", 1); \
+        if (g->gz) yajl_gz_flush(g->gz, 1);                  \
+        YAJL_PROBE2(gen__flush, g, 1);                       \
+    }
 
 yajl_gen_status
 yajl_gen_integer(yajl_gen g, long long int number)
 {
     char i[32];
+    BEGIN_OUTPUT;
     ENSURE_VALID_STATE; ENSURE_NOT_KEY; INSERT_SEP; INSERT_WHITESPACE;
     sprintf(i, "%lld", number);
     g->print(g->ctx, i, (unsigned int)strlen(i));
     APPENDED_ATOM;
     FINAL_NEWLINE;
+    END_OUTPUT;
     return yajl_gen_status_ok;
 }
 
@@ -219,6 +522,7 @@ yajl_gen_status
 yajl_gen_double(yajl_gen g, double number)
 {
     char i[32];
+    BEGIN_OUTPUT;
     ENSURE_VALID_STATE; ENSURE_NOT_KEY; 
     if (isnan(number) || isinf(number)) return yajl_gen_invalid_number;
     INSERT_SEP; INSERT_WHITESPACE;
@@ -229,16 +533,19 @@ yajl_gen_double(yajl_gen g, double number)
     g->print(g->ctx, i, (unsigned int)strlen(i));
     APPENDED_ATOM;
     FINAL_NEWLINE;
+    END_OUTPUT;
     return yajl_gen_status_ok;
 }
 
 yajl_gen_status
 yajl_gen_number(yajl_gen g, const char * s, size_t l)
 {
+    BEGIN_OUTPUT;
     ENSURE_VALID_STATE; ENSURE_NOT_KEY; INSERT_SEP; INSERT_WHITESPACE;
-    g->print(g->ctx, s, l);
+    g->printRef(g->ctx, s, l);
     APPENDED_ATOM;
     FINAL_NEWLINE;
+    END_OUTPUT;
     return yajl_gen_status_ok;
 }
 
@@ -246,6 +553,7 @@ yajl_gen_status
 yajl_gen_string(yajl_gen g, const unsigned char * str,
                 size_t len)
 {
+    BEGIN_OUTPUT;
     // if validation is enabled, check that the string is valid utf8
     // XXX: This checking could be done a little faster, in the same pass as
     // the string encoding
@@ -256,20 +564,67 @@ yajl_gen_string(yajl_gen g, const unsigned char * str,
     }
     ENSURE_VALID_STATE; INSERT_SEP; INSERT_WHITESPACE;
     g->print(g->ctx, "\"", 1);
-    yajl_string_encode(g->print, g->ctx, str, len, g->flags & yajl_gen_escape_solidus);
+    yajl_string_encode(g->printRef, g->ctx, str, len, g->flags & yajl_gen_escape_solidus);
+    g->print(g->ctx, "\"", 1);
+    APPENDED_ATOM;
+    FINAL_NEWLINE;
+    END_OUTPUT;
+    return yajl_gen_status_ok;
+}
+
+yajl_gen_status
+yajl_gen_string_begin(yajl_gen g)
+{
+    BEGIN_OUTPUT;
+    ENSURE_VALID_STATE; INSERT_SEP; INSERT_WHITESPACE;
+    g->print(g->ctx, "\"", 1);
+    g->inString = 1;
+    g->utf8Pending = 0;
+    END_OUTPUT;
+    return yajl_gen_status_ok;
+}
+
+yajl_gen_status
+yajl_gen_string_append(yajl_gen g, const unsigned char * str, size_t len)
+{
+    BEGIN_OUTPUT;
+    if (!g->inString) return yajl_gen_no_string_in_progress;
+    if (g->flags & yajl_gen_validate_utf8) {
+        unsigned int pending = g->utf8Pending;
+        if (len && !yajl_string_validate_utf8_partial(str, len, &pending)) {
+            return yajl_gen_invalid_string;
+        }
+        g->utf8Pending = pending;
+    }
+    yajl_string_encode(g->printRef, g->ctx, str, len, g->flags & yajl_gen_escape_solidus);
+    END_OUTPUT;
+    return yajl_gen_status_ok;
+}
+
+yajl_gen_status
+yajl_gen_string_end(yajl_gen g)
+{
+    BEGIN_OUTPUT;
+    if (!g->inString) return yajl_gen_no_string_in_progress;
+    /* the string stopped in the middle of a multi-byte character */
+    if (g->utf8Pending) return yajl_gen_invalid_string;
     g->print(g->ctx, "\"", 1);
+    g->inString = 0;
     APPENDED_ATOM;
     FINAL_NEWLINE;
+    END_OUTPUT;
     return yajl_gen_status_ok;
 }
 
 yajl_gen_status
 yajl_gen_null(yajl_gen g)
 {
+    BEGIN_OUTPUT;
     ENSURE_VALID_STATE; ENSURE_NOT_KEY; INSERT_SEP; INSERT_WHITESPACE;
     g->print(g->ctx, "null", strlen("null"));
     APPENDED_ATOM;
     FINAL_NEWLINE;
+    END_OUTPUT;
     return yajl_gen_status_ok;
 }
 
@@ -278,29 +633,33 @@ yajl_gen_bool(yajl_gen g, int boolean)
 {
     const char * val = boolean ? "true" : "false";
 
+    BEGIN_OUTPUT;
 	ENSURE_VALID_STATE; ENSURE_NOT_KEY; INSERT_SEP; INSERT_WHITESPACE;
     g->print(g->ctx, val, (unsigned int)strlen(val));
     APPENDED_ATOM;
     FINAL_NEWLINE;
+    END_OUTPUT;
     return yajl_gen_status_ok;
 }
 
 yajl_gen_status
 yajl_gen_map_open(yajl_gen g)
 {
+    BEGIN_OUTPUT;
     ENSURE_VALID_STATE; ENSURE_NOT_KEY; INSERT_SEP; INSERT_WHITESPACE;
-    INCREMENT_DEPTH; 
-    
-    g->state[g->depth] = yajl_gen_map_start;
+    INCREMENT_DEPTH(yajl_gen_map_start);
+
     g->print(g->ctx, "{", 1);
     if ((g->flags & yajl_gen_beautify)) g->print(g->ctx, "\n", 1);
     FINAL_NEWLINE;
+    END_OUTPUT;
     return yajl_gen_status_ok;
 }
 
 yajl_gen_status
 yajl_gen_map_close(yajl_gen g)
 {
+    BEGIN_OUTPUT;
     ENSURE_VALID_STATE; 
     DECREMENT_DEPTH;
     
@@ -309,24 +668,27 @@ yajl_gen_map_close(yajl_gen g)
     INSERT_WHITESPACE;
     g->print(g->ctx, "}", 1);
     FINAL_NEWLINE;
+    END_OUTPUT;
     return yajl_gen_status_ok;
 }
 
 yajl_gen_status
 yajl_gen_array_open(yajl_gen g)
 {
+    BEGIN_OUTPUT;
     ENSURE_VALID_STATE; ENSURE_NOT_KEY; INSERT_SEP; INSERT_WHITESPACE;
-    INCREMENT_DEPTH; 
-    g->state[g->depth] = yajl_gen_array_start;
+    INCREMENT_DEPTH(yajl_gen_array_start);
     g->print(g->ctx, "[", 1);
     if ((g->flags & yajl_gen_beautify)) g->print(g->ctx, "\n", 1);
     FINAL_NEWLINE;
+    END_OUTPUT;
     return yajl_gen_status_ok;
 }
 
 yajl_gen_status
 yajl_gen_array_close(yajl_gen g)
 {
+    BEGIN_OUTPUT;
     ENSURE_VALID_STATE;
     DECREMENT_DEPTH;
     if ((g->flags & yajl_gen_beautify)) g->print(g->ctx, "\n", 1);
@@ -334,6 +696,58 @@ yajl_gen_array_close(yajl_gen g)
     INSERT_WHITESPACE;
     g->print(g->ctx, "]", 1);
     FINAL_NEWLINE;
+    END_OUTPUT;
+    return yajl_gen_status_ok;
+}
+
+yajl_gen_status
+yajl_gen_splice(yajl_gen g, yajl_gen f)
+{
+    const unsigned char * buf;
+    size_t len;
+    yajl_gen_state fs;
+    BEGIN_OUTPUT;
+
+    ENSURE_VALID_STATE;
+
+    /* the fragment must have been generated for this very spot */
+    if (!f->baseDepth || f->inString || f->depth != f->baseDepth ||
+        f->depth != g->depth ||
+        (f->flags & yajl_gen_beautify) != (g->flags & yajl_gen_beautify))
+    {
+        return yajl_gen_fragment_mismatch;
+    }
+    fs = yajl_bs_current(f->stateStack);
+    switch (yajl_bs_current(g->stateStack)) {
+        case yajl_gen_array_start:
+        case yajl_gen_in_array:
+            if (fs != yajl_gen_array_start && fs != yajl_gen_in_array) {
+                return yajl_gen_fragment_mismatch;
+            }
+            break;
+        case yajl_gen_map_start:
+        case yajl_gen_map_key:
+            if (fs != yajl_gen_map_start && fs != yajl_gen_map_key) {
+                return yajl_gen_fragment_mismatch;
+            }
+            break;
+        default:
+            return yajl_gen_fragment_mismatch;
+    }
+
+    /* nothing generated yet, nothing to splice */
+    if (fs == yajl_gen_array_start || fs == yajl_gen_map_start) {
+        return yajl_gen_status_ok;
+    }
+    /* compressed fragments can't be stitched into a document */
+    if (f->gz || yajl_gen_get_buf(f, &buf, &len) != yajl_gen_status_ok) {
+        return yajl_gen_no_buf;
+    }
+
+    INSERT_SEP;
+    g->printRef(g->ctx, (const char *) buf, len);
+    yajl_bs_set(g->stateStack, fs);
+    END_OUTPUT;
     return yajl_gen_status_ok;
 }
 
@@ -341,14 +755,90 @@ yajl_gen_status
 yajl_gen_get_buf(yajl_gen g, const unsigned char ** buf,
                  size_t * len)
 {
-    if (g->print != (yajl_print_t)&yajl_buf_append) return yajl_gen_no_buf;
-    *buf = yajl_buf_data((yajl_buf)g->ctx);
-    *len = yajl_buf_len((yajl_buf)g->ctx);
+    void * ctx;
+
+    if (g->print == &yajl_gen_fixed_append) {
+        *buf = g->fixed.data;
+        *len = g->fixed.used;
+        YAJL_PROBE2(gen__get__buf, g, *len);
+        return yajl_gen_status_ok;
+    }
+    if (yajl_gen_sink(g, &ctx) != (yajl_print_t)&yajl_buf_append) {
+        return yajl_gen_no_buf;
+    }
+    *buf = yajl_buf_data((yajl_buf)ctx);
+    *len = yajl_buf_len((yajl_buf)ctx);
+    YAJL_PROBE2(gen__get__buf, g, *len);
+    return yajl_gen_status_ok;
+}
+
+yajl_gen_status
+yajl_gen_get_iovec(yajl_gen g, const yajl_gen_iovec ** iov, size_t * count)
+{
+    yajl_gen_iov_sink * sink;
+    const unsigned char * side;
+    size_t i;
+
+    if (g->print != &yajl_gen_iov_copy) return yajl_gen_no_buf;
+    sink = (yajl_gen_iov_sink *) g->ctx;
+
+    if (sink->iovAlloc < sink->numSegs) {
+        sink->iov = (yajl_gen_iovec *)
+            YA_REALLOC(sink->alloc, sink->iov,
+                       sink->segsAlloc * sizeof(yajl_gen_iovec));
+        sink->iovAlloc = sink->segsAlloc;
+    }
+
+    /* the side buffer may have moved as it grew, so resolve its
+     * segments only now */
+    side = yajl_buf_data(sink->side);
+    for (i = 0; i < sink->numSegs; i++) {
+        sink->iov[i] = sink->segs[i];
+        if (sink->iov[i].iov_base == NULL) {
+            sink->iov[i].iov_base = side;
+            side += sink->iov[i].iov_len;
+        }
+    }
+
+    *iov = sink->iov;
+    *count = sink->numSegs;
+    return yajl_gen_status_ok;
+}
+
+yajl_gen_status
+yajl_gen_flush(yajl_gen g)
+{
+    YAJL_PROBE2(gen__flush, g, 0);
+    if (g->gz) yajl_gz_flush(g->gz, 0);
     return yajl_gen_status_ok;
 }
 
 void
 yajl_gen_clear(yajl_gen g)
 {
-    if (g->print == (yajl_print_t)&yajl_buf_append) yajl_buf_clear((yajl_buf)g->ctx);
+    void * ctx;
+    yajl_print_t print = yajl_gen_sink(g, &ctx);
+
+    if (print == (yajl_print_t)&yajl_buf_append) yajl_buf_clear((yajl_buf)ctx);
+    else if (g->print == &yajl_gen_fixed_append) g->fixed.used = 0;
+    else if (g->print == &yajl_gen_iov_copy) {
+        yajl_gen_iov_sink * sink = (yajl_gen_iov_sink *) g->ctx;
+        yajl_buf_clear(sink->side);
+        sink->numSegs = 0;
+    }
+
+    /* a cleared fragment starts a new run of members, which mustn't
+     * begin with the separator yajl_gen_splice() puts between runs */
+    if (g->baseDepth && g->depth == g->baseDepth) {
+        switch (yajl_bs_current(g->stateStack)) {
+            case yajl_gen_in_array:
+                yajl_bs_set(g->stateStack, yajl_gen_array_start);
+                break;
+            case yajl_gen_map_key:
+                yajl_bs_set(g->stateStack, yajl_gen_map_start);
+                break;
+            default:
+                break;
+        }
+    }
 }
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2007-2011, Lloyd Hilaiel <lloyd@hilaiel.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "yajl_gz.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef YAJL_HAVE_ZLIB
+
+#include <zlib.h>
+
+/* output is collected and compressed in blocks of this size, and
+ * compressed data is handed to the sink in blocks of this size */
+#define YAJL_GZ_BLOCK_SIZE 65536
+
+/* the most input handed to zlib at once, which counts in uInts */
+#define YAJL_GZ_MAX_INPUT (1u << 30)
+
+struct yajl_gz_t {
+    z_stream zs;
+    /* output waiting to be compressed */
+    unsigned char * block;
+    size_t used;
+    /* compressed output waiting to be printed */
+    unsigned char * out;
+    /* the sink compressed output goes to */
+    yajl_print_t print;
+    void * ctx;
+    /* set once the gzip stream has been ended */
+    unsigned int finished;
+    yajl_alloc_funcs * alloc;
+};
+
+static voidpf
+yajl_gz_zalloc(voidpf opaque, uInt items, uInt size)
+{
+    return YA_MALLOC((yajl_alloc_funcs *) opaque, (size_t) items * size);
+}
+
+static void
+yajl_gz_zfree(voidpf opaque, voidpf address)
+{
+    YA_FREE((yajl_alloc_funcs *) opaque, address);
+}
+
+/* compress len bytes of data, print whatever zlib produces, and apply
+ * flush once all of the input has been consumed */
+static void
+yajl_gz_deflate(yajl_gz gz, const unsigned char * data, size_t len,
+                int flush)
+{
+    do {
+        size_t n = len < YAJL_GZ_MAX_INPUT ? len : YAJL_GZ_MAX_INPUT;
+        int mode = (n == len) ? flush : Z_NO_FLUSH;
+
+        gz->zs.next_in = (Bytef *) data;
+        gz->zs.avail_in = (uInt) n;
+        data += n;
+        len -= n;
+
+        /* a full output block means zlib may have more for us */
+        do {
+            size_t have;
+            gz->zs.next_out = gz->out;
+            gz->zs.avail_out = YAJL_GZ_BLOCK_SIZE;
+            deflate(&(gz->zs), mode);
+            have = YAJL_GZ_BLOCK_SIZE - gz->zs.avail_out;
+            if (have) gz->print(gz->ctx, (const char *) gz->out, have);
+        } while (gz->zs.avail_out == 0);
+    } while (len);
+}
+
+yajl_gz
+yajl_gz_alloc(yajl_alloc_funcs * alloc, int level,
+              yajl_print_t print, void * ctx)
+{
+    yajl_gz gz = (yajl_gz) YA_MALLOC(alloc, sizeof(struct yajl_gz_t));
+    if (!gz) return NULL;
+    memset((void *) gz, 0, sizeof(struct yajl_gz_t));
+
+    gz->alloc = alloc;
+    gz->print = print;
+    gz->ctx = ctx;
+    gz->zs.zalloc = &yajl_gz_zalloc;
+    gz->zs.zfree = &yajl_gz_zfree;
+    gz->zs.opaque = (voidpf) alloc;
+
+    /* 16 added to the window bits asks for a gzip rather than a zlib
+     * wrapper around the deflate stream */
+    if (deflateInit2(&(gz->zs), level, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        YA_FREE(alloc, gz);
+        return NULL;
+    }
+
+    gz->block = (unsigned char *) YA_MALLOC(alloc, YAJL_GZ_BLOCK_SIZE);
+    gz->out = (unsigned char *) YA_MALLOC(alloc, YAJL_GZ_BLOCK_SIZE);
+    if (!gz->block || !gz->out) {
+        yajl_gz_free(gz);
+        return NULL;
+    }
+
+    return gz;
+}
+
+void
+yajl_gz_free(yajl_gz gz)
+{
+    deflateEnd(&(gz->zs));
+    if (gz->block) YA_FREE(gz->alloc, gz->block);
+    if (gz->out) YA_FREE(gz->alloc, gz->out);
+    YA_FREE(gz->alloc, gz);
+}
+
+void
+yajl_gz_print(void * ctx, const char * str, size_t len)
+{
+    yajl_gz gz = (yajl_gz) ctx;
+
+    if (gz->finished) return;
+
+    if (len > YAJL_GZ_BLOCK_SIZE - gz->used) {
+        yajl_gz_deflate(gz, gz->block, gz->used, Z_NO_FLUSH);
+        gz->used = 0;
+        /* large output is big enough to compress without collecting */
+        if (len >= YAJL_GZ_BLOCK_SIZE) {
+            yajl_gz_deflate(gz, (const unsigned char *) str, len,
+                            Z_NO_FLUSH);
+            return;
+        }
+    }
+    memcpy(gz->block + gz->used, str, len);
+    gz->used += len;
+}
+
+void
+yajl_gz_flush(yajl_gz gz, int finish)
+{
+    if (gz->finished) return;
+    yajl_gz_deflate(gz, gz->block, gz->used,
+                    finish ? Z_FINISH : Z_SYNC_FLUSH);
+    gz->used = 0;
+    gz->finished = finish;
+}
+
+void
+yajl_gz_sink(yajl_gz gz, yajl_print_t * print, void ** ctx)
+{
+    *print = gz->print;
+    *ctx = gz->ctx;
+}
+
+#else
+
+/* built without zlib: there is never a compressor to use */
+
+yajl_gz
+yajl_gz_alloc(yajl_alloc_funcs * alloc, int level,
+              yajl_print_t print, void * ctx)
+{
+    return NULL;
+}
+
+void yajl_gz_free(yajl_gz gz) { }
+
+void yajl_gz_print(void * ctx, const char * str, size_t len) { }
+
+void yajl_gz_flush(yajl_gz gz, int finish) { }
+
+void
+yajl_gz_sink(yajl_gz gz, yajl_print_t * print, void ** ctx)
+{
+    *print = NULL;
+    *ctx = NULL;
+}
+
+#endif
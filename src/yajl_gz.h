@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2007-2011, Lloyd Hilaiel <lloyd@hilaiel.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __YAJL_GZ_H__
+#define __YAJL_GZ_H__
+
+#include "api/yajl_gen.h"
+#include "yajl_alloc.h"
+
+/*
+ * yajl_gz is a gzip compressor which sits in front of a generator output
+ * sink.  Output printed to it is collected into large blocks before being
+ * handed to zlib, and compressed data is printed to the sink as it is
+ * produced.  Without zlib (YAJL_HAVE_ZLIB undefined) yajl_gz_alloc always
+ * fails.
+ */
+typedef struct yajl_gz_t * yajl_gz;
+
+/* allocate a compressor at the given zlib compression level, -1 for
+ * zlib's default, which prints compressed output to print and ctx.
+ * returns NULL when compression isn't available or level is invalid */
+yajl_gz yajl_gz_alloc(yajl_alloc_funcs * alloc, int level,
+                      yajl_print_t print, void * ctx);
+
+/* free the compressor.  the sink behind it is left alone */
+void yajl_gz_free(yajl_gz gz);
+
+/* compress some output, a yajl_print_t taking a yajl_gz as context */
+void yajl_gz_print(void * ctx, const char * str, size_t len);
+
+/* push everything printed so far through to the sink.  if finish is
+ * non-zero the gzip stream is ended, and further output is dropped */
+void yajl_gz_flush(yajl_gz gz, int finish);
+
+/* get the sink compressed output is printed to */
+void yajl_gz_sink(yajl_gz gz, yajl_print_t * print, void ** ctx);
+
+#endif
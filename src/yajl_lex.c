@@ -65,34 +65,6 @@ tokToStr(yajl_tok tok)
  * before pulling chars from input text
  */
 
-struct yajl_lexer_t {
-    /* the overal line and char offset into the data */
-    size_t lineOff;
-    size_t charOff;
-
-    /* error */
-    yajl_lex_error error;
-
-    /* a input buffer to handle the case where a token is spread over
-     * multiple chunks */ 
-    yajl_buf buf;
-
-    /* in the case where we have data in the lexBuf, bufOff holds
-     * the current offset into the lexBuf. */
-    size_t bufOff;
-
-    /* are we using the lex buf? */
-    unsigned int bufInUse;
-
-    /* shall we allow comments? */
-    unsigned int allowComments;
-
-    /* shall we validate utf8 inside strings? */
-    unsigned int validateUTF8;
-
-    yajl_alloc_funcs * alloc;
-};
-
 #define readChar(lxr, txt, off)                      \
     (((lxr)->bufInUse && yajl_buf_len((lxr)->buf) && lxr->bufOff < yajl_buf_len((lxr)->buf)) ? \
      (*((const unsigned char *) yajl_buf_data((lxr)->buf) + ((lxr)->bufOff)++)) : \
@@ -105,22 +77,55 @@ yajl_lex_alloc(yajl_alloc_funcs * alloc,
                unsigned int allowComments, unsigned int validateUTF8)
 {
     yajl_lexer lxr = (yajl_lexer) YA_MALLOC(alloc, sizeof(struct yajl_lexer_t));
-    memset((void *) lxr, 0, sizeof(struct yajl_lexer_t));
-    lxr->buf = yajl_buf_alloc(alloc);
-    lxr->allowComments = allowComments;
-    lxr->validateUTF8 = validateUTF8;
-    lxr->alloc = alloc;
+    yajl_lex_init(lxr, alloc, allowComments, validateUTF8);
     return lxr;
 }
 
 void
 yajl_lex_free(yajl_lexer lxr)
 {
-    yajl_buf_free(lxr->buf);
+    yajl_lex_release(lxr);
     YA_FREE(lxr->alloc, lxr);
     return;
 }
 
+void
+yajl_lex_init(yajl_lexer lxr, yajl_alloc_funcs * alloc,
+              unsigned int allowComments, unsigned int validateUTF8)
+{
+    memset((void *) lxr, 0, sizeof(struct yajl_lexer_t));
+    lxr->buf = &(lxr->bufStore);
+    yajl_buf_init(lxr->buf, alloc, lxr->bufInline, sizeof(lxr->bufInline));
+    lxr->allowComments = allowComments;
+    lxr->validateUTF8 = validateUTF8;
+    lxr->alloc = alloc;
+}
+
+void
+yajl_lex_reset(yajl_lexer lxr,
+               unsigned int allowComments, unsigned int validateUTF8)
+{
+    lxr->lineOff = 0;
+    lxr->charOff = 0;
+    lxr->error = yajl_lex_e_ok;
+    yajl_buf_clear(lxr->buf);
+    lxr->bufOff = 0;
+    lxr->bufInUse = 0;
+    lxr->allowComments = allowComments;
+    lxr->validateUTF8 = validateUTF8;
+#ifndef YAJL_NO_STATS
+    memset((void *) lxr->tokenCounts, 0, sizeof(lxr->tokenCounts));
+    lxr->bufferedTokens = 0;
+    lxr->bufferedBytes = 0;
+#endif
+}
+
+void
+yajl_lex_release(yajl_lexer lxr)
+{
+    yajl_buf_release(lxr->buf);
+}
+
 /* a lookup table which lets us quickly determine three things:
  * VEC - valid escaped control char
  * note.  the solidus '/' may be escaped or not.
@@ -656,12 +661,16 @@ yajl_lex_lex(yajl_lexer lexer, const unsigned char * jsonText,
             *outBuf = yajl_buf_data(lexer->buf);
             *outLen = yajl_buf_len(lexer->buf);
             lexer->bufInUse = 0;
+            YAJL_STAT(lexer->bufferedTokens++);
+            YAJL_STAT(lexer->bufferedBytes += *outLen);
         }
     } else if (tok != yajl_tok_error) {
         *outBuf = jsonText + startOffset;
         *outLen = *offset - startOffset;
     }
 
+    YAJL_STAT(lexer->tokenCounts[tok]++);
+
     /* special case for strings. skip the quotes. */
     if (tok == yajl_tok_string || tok == yajl_tok_string_with_escapes)
     {
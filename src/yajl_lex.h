@@ -18,6 +18,8 @@
 #define __YAJL_LEX_H__
 
 #include "api/yajl_common.h"
+#include "yajl_buf.h"
+#include "yajl_stats.h"
 
 typedef enum {
     yajl_tok_bool,         
@@ -53,6 +55,19 @@ yajl_lexer yajl_lex_alloc(yajl_alloc_funcs * alloc,
 
 void yajl_lex_free(yajl_lexer lexer);
 
+/* set up a lexer embedded in some other structure */
+void yajl_lex_init(yajl_lexer lexer, yajl_alloc_funcs * alloc,
+                   unsigned int allowComments,
+                   unsigned int validateUTF8);
+
+/* return a lexer to its initial state for a new text, keeping its
+ * buffer */
+void yajl_lex_reset(yajl_lexer lexer, unsigned int allowComments,
+                    unsigned int validateUTF8);
+
+/* free the memory an initialized lexer has allocated */
+void yajl_lex_release(yajl_lexer lexer);
+
 /**
  * run/continue a lex. "offset" is an input/output parameter.
  * It should be initialized to zero for a
@@ -100,6 +115,50 @@ typedef enum {
 
 const char * yajl_lex_error_to_string(yajl_lex_error error);
 
+/* tokens spread over multiple chunks are buffered in the lexer, inline
+ * when they're short */
+#define YAJL_LEX_INLINE_BUF_SIZE 64
+
+/* the lexer is exposed so that it may be embedded in the parser handle.
+ * access it with yajl_lex_XXX routines */
+struct yajl_lexer_t {
+    /* the overal line and char offset into the data */
+    size_t lineOff;
+    size_t charOff;
+
+    /* error */
+    yajl_lex_error error;
+
+    /* a input buffer to handle the case where a token is spread over
+     * multiple chunks */ 
+    yajl_buf buf;
+    struct yajl_buf_t bufStore;
+    unsigned char bufInline[YAJL_LEX_INLINE_BUF_SIZE];
+
+    /* in the case where we have data in the lexBuf, bufOff holds
+     * the current offset into the lexBuf. */
+    size_t bufOff;
+
+    /* are we using the lex buf? */
+    unsigned int bufInUse;
+
+    /* shall we allow comments? */
+    unsigned int allowComments;
+
+    /* shall we validate utf8 inside strings? */
+    unsigned int validateUTF8;
+
+#ifndef YAJL_NO_STATS
+    /* tokens lexed by type, and those which were buffered because they
+     * crossed chunks */
+    size_t tokenCounts[yajl_tok_comment + 1];
+    size_t bufferedTokens;
+    size_t bufferedBytes;
+#endif
+
+    yajl_alloc_funcs * alloc;
+};
+
 /** allows access to more specific information about the lexical
  *  error when yajl_lex_lex returns yajl_tok_error. */
 yajl_lex_error yajl_lex_get_error(yajl_lexer lexer);
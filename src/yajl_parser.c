@@ -19,6 +19,7 @@
 #include "yajl_parser.h"
 #include "yajl_encode.h"
 #include "yajl_bytestack.h"
+#include "yajl_trace.h"
 
 #include <stdlib.h>
 #include <limits.h>
@@ -145,15 +146,142 @@ yajl_render_error_string(yajl_handle hand, const unsigned char * jsonText,
     return str;
 }
 
+/* get the text of a string token to hand to a callback: decoded into
+ * client memory when the client provides it, otherwise decoded into
+ * decodeBuf if it has escapes.  returns NULL if the client couldn't
+ * provide memory */
+static const unsigned char *
+yajl_string_text(yajl_handle hand, yajl_tok tok, const unsigned char * buf,
+                 size_t * len)
+{
+    if (hand->stringAlloc) {
+        unsigned char * out;
+        size_t outLen = (tok == yajl_tok_string_with_escapes) ?
+            yajl_string_decoded_length(buf, *len) : *len;
+
+        out = hand->stringAlloc(hand->ctx, outLen);
+        if (!out) return NULL;
+        if (tok == yajl_tok_string_with_escapes) {
+            yajl_string_decode_raw(out, buf, *len);
+        } else {
+            memcpy(out, buf, *len);
+        }
+        out[outLen] = 0;
+        *len = outLen;
+        return out;
+    }
+    if (tok == yajl_tok_string_with_escapes) {
+        yajl_buf_clear(hand->decodeBuf);
+        yajl_string_decode(hand->decodeBuf, buf, *len);
+        *len = yajl_buf_len(hand->decodeBuf);
+        YAJL_STAT(hand->stats.decodedBytes += *len);
+        return yajl_buf_data(hand->decodeBuf);
+    }
+    return buf;
+}
+
+/* move the parser to an error state */
+#define yajl_set_error_state(state)                               \
+    do {                                                          \
+        yajl_bs_set(hand->stateStack, (state));                   \
+        YAJL_PROBE3(parse__error, hand, hand->bytesConsumed,      \
+                    (int) (state));                               \
+    } while (0)
+
+/* callbacks are timed during sampled parse calls */
+#ifndef YAJL_NO_STATS
+static int
+yajl_callback_done(yajl_handle hand, int rv)
+{
+    hand->stats.sampledCallbackNs +=
+        yajl_stats_clock() - hand->callbackStart;
+    return rv;
+}
+
+#define _CC_CALL(x)                                               \
+    (hand->timing ?                                               \
+     (hand->callbackStart = yajl_stats_clock(),                   \
+      yajl_callback_done(hand, (x))) : (x))
+#else
+#define _CC_CALL(x) (x)
+#endif
+
 /* check for client cancelation */
 #define _CC_CHK(x)                                                \
-    if (!(x)) {                                                   \
-        yajl_bs_set(hand->stateStack, yajl_state_parse_error);    \
+    if (!_CC_CALL(x)) {                                                   \
+        yajl_set_error_state(yajl_state_parse_error);             \
         hand->parseError =                                        \
             "client cancelled parse via callback return value";   \
         return yajl_status_client_canceled;                       \
     }
 
+/* check that yajl_string_text got the memory it asked the client for */
+#define _STRING_CHK(x)                                            \
+    if ((x) == NULL) {                                            \
+        yajl_set_error_state(yajl_state_parse_error);             \
+        hand->parseError =                                        \
+            "no memory from yajl_string_alloc function";          \
+        return yajl_status_error;                                 \
+    }
+
+
+/* minifying: print the run of tokens not yet printed */
+static void
+yajl_minify_flush(yajl_handle hand)
+{
+    if (hand->minifyRunLen) {
+        hand->minifyPrint(hand->minifyCtx, (const char *) hand->minifyRun,
+                          hand->minifyRunLen);
+        hand->minifyRunLen = 0;
+    }
+}
+
+/* minifying: print a token the parser accepted, with the quotes of a
+ * string, joining it to the current run when it follows on in the text */
+static void
+yajl_minify_token(yajl_handle hand, const unsigned char * jsonText,
+                  size_t offset, yajl_tok tok, const unsigned char * buf,
+                  size_t bufLen)
+{
+    if (tok == yajl_tok_string || tok == yajl_tok_string_with_escapes) {
+        buf--;
+        bufLen += 2;
+    }
+    /* a token assembled in the lexer's buffer is printed alone */
+    if (offset < bufLen || buf != jsonText + offset - bufLen) {
+        yajl_minify_flush(hand);
+        hand->minifyPrint(hand->minifyCtx, (const char *) buf, bufLen);
+    } else if (hand->minifyRunLen &&
+               hand->minifyRun + hand->minifyRunLen == buf)
+    {
+        hand->minifyRunLen += bufLen;
+    } else {
+        yajl_minify_flush(hand);
+        hand->minifyRun = buf;
+        hand->minifyRunLen = bufLen;
+    }
+}
+
+#define yajl_minify_emit(tok)                                     \
+    if (hand->minifyPrint) {                                      \
+        yajl_minify_token(hand, jsonText, *offset, (tok), buf,    \
+                          bufLen);                                \
+    }
+
+static yajl_status
+yajl_parse_tokens(yajl_handle hand, const unsigned char * jsonText,
+                  size_t jsonTextLen);
+
+yajl_status
+yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
+              size_t jsonTextLen)
+{
+    yajl_status stat = yajl_parse_tokens(hand, jsonText, jsonTextLen);
+
+    /* the run is of this text, which the client may reuse on return */
+    if (hand->minifyPrint) yajl_minify_flush(hand);
+    return stat;
+}
 
 yajl_status
 yajl_do_finish(yajl_handle hand)
@@ -174,7 +302,7 @@ yajl_do_finish(yajl_handle hand)
         default:
             if (!(hand->flags & yajl_allow_partial_values))
             {
-                yajl_bs_set(hand->stateStack, yajl_state_parse_error);
+                yajl_set_error_state(yajl_state_parse_error);
                 hand->parseError = "premature EOF";
                 return yajl_status_error;
             }
@@ -182,9 +310,9 @@ yajl_do_finish(yajl_handle hand)
     }
 }
 
-yajl_status
-yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
-              size_t jsonTextLen)
+static yajl_status
+yajl_parse_tokens(yajl_handle hand, const unsigned char * jsonText,
+                  size_t jsonTextLen)
 {
     yajl_tok tok;
     const unsigned char * buf;
@@ -197,6 +325,10 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
     switch (yajl_bs_current(hand->stateStack)) {
         case yajl_state_parse_complete:
             if (hand->flags & yajl_allow_multiple_values) {
+                if (hand->minifyPrint) {
+                    yajl_minify_flush(hand);
+                    hand->minifyPrint(hand->minifyCtx, "\n", 1);
+                }
                 yajl_bs_set(hand->stateStack, yajl_state_got_value);
                 goto around_again;
             }
@@ -205,7 +337,7 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                     tok = yajl_lex_lex(hand->lexer, jsonText, jsonTextLen,
                                        offset, &buf, &bufLen);
                     if (tok != yajl_tok_eof) {
-                        yajl_bs_set(hand->stateStack, yajl_state_parse_error);
+                        yajl_set_error_state(yajl_state_parse_error);
                         hand->parseError = "trailing garbage";
                     }
                     goto around_again;
@@ -236,47 +368,47 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                 case yajl_tok_eof:
                     return yajl_status_ok;
                 case yajl_tok_error:
-                    yajl_bs_set(hand->stateStack, yajl_state_lexical_error);
+                    yajl_set_error_state(yajl_state_lexical_error);
                     goto around_again;
                 case yajl_tok_string:
+                case yajl_tok_string_with_escapes:
+                    yajl_minify_emit(tok);
                     if (hand->callbacks && hand->callbacks->yajl_string) {
+                        buf = yajl_string_text(hand, tok, buf, &bufLen);
+                        _STRING_CHK(buf);
                         _CC_CHK(hand->callbacks->yajl_string(hand->ctx,
                                                              buf, bufLen));
                     }
                     break;
-                case yajl_tok_string_with_escapes:
-                    if (hand->callbacks && hand->callbacks->yajl_string) {
-                        yajl_buf_clear(hand->decodeBuf);
-                        yajl_string_decode(hand->decodeBuf, buf, bufLen);
-                        _CC_CHK(hand->callbacks->yajl_string(
-                                    hand->ctx, yajl_buf_data(hand->decodeBuf),
-                                    yajl_buf_len(hand->decodeBuf)));
-                    }
-                    break;
                 case yajl_tok_bool:
+                    yajl_minify_emit(tok);
                     if (hand->callbacks && hand->callbacks->yajl_boolean) {
                         _CC_CHK(hand->callbacks->yajl_boolean(hand->ctx,
                                                               *buf == 't'));
                     }
                     break;
                 case yajl_tok_null:
+                    yajl_minify_emit(tok);
                     if (hand->callbacks && hand->callbacks->yajl_null) {
                         _CC_CHK(hand->callbacks->yajl_null(hand->ctx));
                     }
                     break;
                 case yajl_tok_left_bracket:
+                    yajl_minify_emit(tok);
                     if (hand->callbacks && hand->callbacks->yajl_start_map) {
                         _CC_CHK(hand->callbacks->yajl_start_map(hand->ctx));
                     }
                     stateToPush = yajl_state_map_start;
                     break;
                 case yajl_tok_left_brace:
+                    yajl_minify_emit(tok);
                     if (hand->callbacks && hand->callbacks->yajl_start_array) {
                         _CC_CHK(hand->callbacks->yajl_start_array(hand->ctx));
                     }
                     stateToPush = yajl_state_array_start;
                     break;
                 case yajl_tok_integer:
+                    yajl_minify_emit(tok);
                     if (hand->callbacks) {
                         if (hand->callbacks->yajl_number) {
                             _CC_CHK(hand->callbacks->yajl_number(
@@ -288,8 +420,7 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                             if ((i == LLONG_MIN || i == LLONG_MAX) &&
                                 errno == ERANGE)
                             {
-                                yajl_bs_set(hand->stateStack,
-                                            yajl_state_parse_error);
+                                yajl_set_error_state(yajl_state_parse_error);
                                 hand->parseError = "integer overflow" ;
                                 /* try to restore error offset */
                                 if (*offset >= bufLen) *offset -= bufLen;
@@ -302,6 +433,7 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                     }
                     break;
                 case yajl_tok_double:
+                    yajl_minify_emit(tok);
                     if (hand->callbacks) {
                         if (hand->callbacks->yajl_number) {
                             _CC_CHK(hand->callbacks->yajl_number(
@@ -311,13 +443,13 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                             yajl_buf_clear(hand->decodeBuf);
                             yajl_buf_append(hand->decodeBuf, buf, bufLen);
                             buf = yajl_buf_data(hand->decodeBuf);
+                            YAJL_STAT(hand->stats.decodedBytes += bufLen);
                             errno = 0;
                             d = strtod((char *) buf, NULL);
                             if ((d == HUGE_VAL || d == -HUGE_VAL) &&
                                 errno == ERANGE)
                             {
-                                yajl_bs_set(hand->stateStack,
-                                            yajl_state_parse_error);
+                                yajl_set_error_state(yajl_state_parse_error);
                                 hand->parseError = "numeric (floating point) "
                                     "overflow";
                                 /* try to restore error offset */
@@ -334,6 +466,7 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                     if (yajl_bs_current(hand->stateStack) ==
                         yajl_state_array_start)
                     {
+                        yajl_minify_emit(tok);
                         if (hand->callbacks &&
                             hand->callbacks->yajl_end_array)
                         {
@@ -347,12 +480,12 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                 case yajl_tok_colon:
                 case yajl_tok_comma:
                 case yajl_tok_right_bracket:
-                    yajl_bs_set(hand->stateStack, yajl_state_parse_error);
+                    yajl_set_error_state(yajl_state_parse_error);
                     hand->parseError =
                         "unallowed token at this point in JSON text";
                     goto around_again;
                 default:
-                    yajl_bs_set(hand->stateStack, yajl_state_parse_error);
+                    yajl_set_error_state(yajl_state_parse_error);
                     hand->parseError = "invalid token, internal error";
                     goto around_again;
             }
@@ -369,6 +502,10 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
             }
             if (stateToPush != yajl_state_start) {
                 yajl_bs_push(hand->stateStack, stateToPush);
+                YAJL_STAT(
+                    if (hand->stateStack.used - 1 > hand->stats.maxDepth)
+                        hand->stats.maxDepth = hand->stateStack.used - 1;
+                );
             }
 
             goto around_again;
@@ -384,18 +521,14 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                 case yajl_tok_eof:
                     return yajl_status_ok;
                 case yajl_tok_error:
-                    yajl_bs_set(hand->stateStack, yajl_state_lexical_error);
+                    yajl_set_error_state(yajl_state_lexical_error);
                     goto around_again;
                 case yajl_tok_string_with_escapes:
-                    if (hand->callbacks && hand->callbacks->yajl_map_key) {
-                        yajl_buf_clear(hand->decodeBuf);
-                        yajl_string_decode(hand->decodeBuf, buf, bufLen);
-                        buf = yajl_buf_data(hand->decodeBuf);
-                        bufLen = yajl_buf_len(hand->decodeBuf);
-                    }
-                    /* intentional fall-through */
                 case yajl_tok_string:
+                    yajl_minify_emit(tok);
                     if (hand->callbacks && hand->callbacks->yajl_map_key) {
+                        buf = yajl_string_text(hand, tok, buf, &bufLen);
+                        _STRING_CHK(buf);
                         _CC_CHK(hand->callbacks->yajl_map_key(hand->ctx, buf,
                                                               bufLen));
                     }
@@ -405,6 +538,7 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                     if (yajl_bs_current(hand->stateStack) ==
                         yajl_state_map_start)
                     {
+                        yajl_minify_emit(tok);
                         if (hand->callbacks && hand->callbacks->yajl_end_map) {
                             _CC_CHK(hand->callbacks->yajl_end_map(hand->ctx));
                         }
@@ -412,7 +546,7 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                         goto around_again;
                     }
                 default:
-                    yajl_bs_set(hand->stateStack, yajl_state_parse_error);
+                    yajl_set_error_state(yajl_state_parse_error);
                     hand->parseError =
                         "invalid object key (must be a string)"; 
                     goto around_again;
@@ -423,15 +557,16 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                                offset, &buf, &bufLen);
             switch (tok) {
                 case yajl_tok_colon:
+                    yajl_minify_emit(tok);
                     yajl_bs_set(hand->stateStack, yajl_state_map_need_val);
                     goto around_again;
                 case yajl_tok_eof:
                     return yajl_status_ok;
                 case yajl_tok_error:
-                    yajl_bs_set(hand->stateStack, yajl_state_lexical_error);
+                    yajl_set_error_state(yajl_state_lexical_error);
                     goto around_again;
                 default:
-                    yajl_bs_set(hand->stateStack, yajl_state_parse_error);
+                    yajl_set_error_state(yajl_state_parse_error);
                     hand->parseError = "object key and value must "
                         "be separated by a colon (':')";
                     goto around_again;
@@ -442,21 +577,23 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                                offset, &buf, &bufLen);
             switch (tok) {
                 case yajl_tok_right_bracket:
+                    yajl_minify_emit(tok);
                     if (hand->callbacks && hand->callbacks->yajl_end_map) {
                         _CC_CHK(hand->callbacks->yajl_end_map(hand->ctx));
                     }
                     yajl_bs_pop(hand->stateStack);
                     goto around_again;
                 case yajl_tok_comma:
+                    yajl_minify_emit(tok);
                     yajl_bs_set(hand->stateStack, yajl_state_map_need_key);
                     goto around_again;
                 case yajl_tok_eof:
                     return yajl_status_ok;
                 case yajl_tok_error:
-                    yajl_bs_set(hand->stateStack, yajl_state_lexical_error);
+                    yajl_set_error_state(yajl_state_lexical_error);
                     goto around_again;
                 default:
-                    yajl_bs_set(hand->stateStack, yajl_state_parse_error);
+                    yajl_set_error_state(yajl_state_parse_error);
                     hand->parseError = "after key and value, inside map, "
                                        "I expect ',' or '}'";
                     /* try to restore error offset */
@@ -470,21 +607,23 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                                offset, &buf, &bufLen);
             switch (tok) {
                 case yajl_tok_right_brace:
+                    yajl_minify_emit(tok);
                     if (hand->callbacks && hand->callbacks->yajl_end_array) {
                         _CC_CHK(hand->callbacks->yajl_end_array(hand->ctx));
                     }
                     yajl_bs_pop(hand->stateStack);
                     goto around_again;
                 case yajl_tok_comma:
+                    yajl_minify_emit(tok);
                     yajl_bs_set(hand->stateStack, yajl_state_array_need_val);
                     goto around_again;
                 case yajl_tok_eof:
                     return yajl_status_ok;
                 case yajl_tok_error:
-                    yajl_bs_set(hand->stateStack, yajl_state_lexical_error);
+                    yajl_set_error_state(yajl_state_lexical_error);
                     goto around_again;
                 default:
-                    yajl_bs_set(hand->stateStack, yajl_state_parse_error);
+                    yajl_set_error_state(yajl_state_parse_error);
                     hand->parseError =
                         "after array element, I expect ',' or ']'";
                     goto around_again;
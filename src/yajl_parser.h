@@ -39,9 +39,15 @@ typedef enum {
     yajl_state_got_value,
 } yajl_state;
 
+/* sizes of the buffers held inline in the handle, which suffice for small
+ * documents without further allocation */
+#define YAJL_DECODE_INLINE_BUF_SIZE 256
+#define YAJL_STATE_INLINE_STACK_SIZE 32
+
 struct yajl_handle_t {
     const yajl_callbacks * callbacks;
     void * ctx;
+    /* lexerStore, once set up for the text by the first parse call */
     yajl_lexer lexer;
     const char * parseError;
     /* the number of bytes consumed from the last client buffer,
@@ -50,12 +56,36 @@ struct yajl_handle_t {
     size_t bytesConsumed;
     /* temporary storage for decoded strings */
     yajl_buf decodeBuf;
+    /* client memory for strings and keys, see yajl_string_alloc */
+    yajl_string_alloc_func stringAlloc;
+    /* memory policies, see yajl_max_memory and yajl_trim_buffers */
+    size_t maxMemory;
+    size_t trimSize;
+    /* see yajl_minify.  the run is of adjacent tokens in the current
+     * text, which haven't been printed yet */
+    yajl_print_t minifyPrint;
+    void * minifyCtx;
+    const unsigned char * minifyRun;
+    size_t minifyRunLen;
     /* a stack of states.  access with yajl_state_XXX routines */
     yajl_bytestack stateStack;
     /* memory allocation routines */
     yajl_alloc_funcs alloc;
     /* bitfield */
     unsigned int flags;
+#ifndef YAJL_NO_STATS
+    /* see yajl_get_stats.  timing is set while a sampled parse call runs,
+     * callbackStart is when the current callback began */
+    yajl_stats stats;
+    int timing;
+    unsigned long long callbackStart;
+#endif
+    /* the lexer, decode buffer and state stack live in the handle with
+     * small inline buffers, so that a handle is a single allocation */
+    struct yajl_lexer_t lexerStore;
+    struct yajl_buf_t decodeBufStore;
+    unsigned char decodeBufInline[YAJL_DECODE_INLINE_BUF_SIZE];
+    unsigned char stateStackInline[YAJL_STATE_INLINE_STACK_SIZE];
 };
 
 yajl_status
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2007-2011, Lloyd Hilaiel <lloyd@hilaiel.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/*
+ * Parser statistics, see yajl_get_stats().  They are compiled in unless
+ * YAJL_NO_STATS is defined.
+ */
+
+#ifndef __YAJL_STATS_H__
+#define __YAJL_STATS_H__
+
+#include "api/yajl_common.h"
+
+/* YAJL_STAT(x) runs x only when statistics are compiled in */
+#ifdef YAJL_NO_STATS
+#  define YAJL_STAT(x)
+#else
+#  define YAJL_STAT(x) x
+#endif
+
+/* one in this many calls to yajl_parse is timed */
+#define YAJL_STATS_SAMPLE_INTERVAL 64
+
+/* a monotonic clock in nanoseconds, for timing parse calls */
+unsigned long long yajl_stats_clock(void);
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2007-2011, Lloyd Hilaiel <lloyd@hilaiel.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/*
+ * Static tracepoints for profiling parsing and generation on live hosts,
+ * e.g. with bpftrace:
+ *
+ *   bpftrace -e 'usdt:libyajl.so:yajl:parse__start { ... }'
+ *
+ * They are compiled in when the build finds <sys/sdt.h> (YAJL_HAVE_SDT),
+ * and cost a nop instruction each until a tracer attaches.  Otherwise
+ * they expand to nothing.  The probes, all in the "yajl" provider, are:
+ *
+ *   parse__start(handle, len)             yajl_parse() is entered
+ *   parse__done(handle, consumed, status) yajl_parse() returns
+ *   parse__error(handle, offset, state)   the parser moves to an error
+ *                                         state (yajl_state_*)
+ *   complete__start(handle)               yajl_complete_parse() is entered
+ *   complete__done(handle, status)        yajl_complete_parse() returns
+ *   gen__get__buf(gen, len)               yajl_gen_get_buf() returns len
+ *                                         bytes
+ *   gen__flush(gen, complete)             yajl_gen_flush() is called (0),
+ *                                         or a document is completed (1)
+ */
+
+#ifndef __YAJL_TRACE_H__
+#define __YAJL_TRACE_H__
+
+#ifdef YAJL_HAVE_SDT
+#  include <sys/sdt.h>
+#  define YAJL_PROBE1(name, a) DTRACE_PROBE1(yajl, name, a)
+#  define YAJL_PROBE2(name, a, b) DTRACE_PROBE2(yajl, name, a, b)
+#  define YAJL_PROBE3(name, a, b, c) DTRACE_PROBE3(yajl, name, a, b, c)
+#else
+#  define YAJL_PROBE1(name, a)
+#  define YAJL_PROBE2(name, a, b)
+#  define YAJL_PROBE3(name, a, b, c)
+#endif
+
+#endif
@@ -47,6 +47,7 @@ struct context_s
     yajl_val root;
     char *errbuf;
     size_t errbuf_size;
+    yajl_alloc_funcs *alloc;
 };
 typedef struct context_s context_t;
 
@@ -56,11 +57,16 @@ typedef struct context_s context_t;
         return (retval);                                                \
     }
 
-static yajl_val value_alloc (yajl_type type)
+/* arrays and objects make room for values in powers of two: they are
+ * full whenever their length is zero or a power of two */
+#define ARRAY_FULL(len) (((len) & ((len) - 1)) == 0)
+#define ARRAY_ROOM(len) ((len) ? 2 * (len) : 1)
+
+static yajl_val value_alloc (context_t *ctx, yajl_type type)
 {
     yajl_val v;
 
-    v = malloc (sizeof (*v));
+    v = YA_MALLOC (ctx->alloc, sizeof (*v));
     if (v == NULL) return (NULL);
     memset (v, 0, sizeof (*v));
     v->type = type;
@@ -68,7 +74,7 @@ static yajl_val value_alloc (yajl_type type)
     return (v);
 }
 
-static void yajl_object_free (yajl_val v)
+static void yajl_object_free (yajl_val v, yajl_alloc_funcs *afs)
 {
     size_t i;
 
@@ -76,18 +82,18 @@ static void yajl_object_free (yajl_val v)
 
     for (i = 0; i < v->u.object.len; i++)
     {
-        free((char *) v->u.object.keys[i]);
+        YA_FREE(afs, (char *) v->u.object.keys[i]);
         v->u.object.keys[i] = NULL;
-        yajl_tree_free (v->u.object.values[i]);
+        yajl_tree_free_alloc (v->u.object.values[i], afs);
         v->u.object.values[i] = NULL;
     }
 
-    free((void*) v->u.object.keys);
-    free(v->u.object.values);
-    free(v);
+    YA_FREE(afs, (void*) v->u.object.keys);
+    YA_FREE(afs, v->u.object.values);
+    YA_FREE(afs, v);
 }
 
-static void yajl_array_free (yajl_val v)
+static void yajl_array_free (yajl_val v, yajl_alloc_funcs *afs)
 {
     size_t i;
 
@@ -95,12 +101,12 @@ static void yajl_array_free (yajl_val v)
 
     for (i = 0; i < v->u.array.len; i++)
     {
-        yajl_tree_free (v->u.array.values[i]);
+        yajl_tree_free_alloc (v->u.array.values[i], afs);
         v->u.array.values[i] = NULL;
     }
 
-    free(v->u.array.values);
-    free(v);
+    YA_FREE(afs, v->u.array.values);
+    YA_FREE(afs, v);
 }
 
 /*
@@ -114,7 +120,7 @@ static int context_push(context_t *ctx, yajl_val v)
 {
     stack_elem_t *stack;
 
-    stack = malloc (sizeof (*stack));
+    stack = YA_MALLOC (ctx->alloc, sizeof (*stack));
     if (stack == NULL)
         RETURN_ERROR (ctx, ENOMEM, "Out of memory");
     memset (stack, 0, sizeof (*stack));
@@ -144,7 +150,7 @@ static yajl_val context_pop(context_t *ctx)
 
     v = stack->value;
 
-    free (stack);
+    YA_FREE (ctx->alloc, stack);
 
     return (v);
 }
@@ -164,15 +170,23 @@ static int object_add_keyval(context_t *ctx,
     /* We're assuring that "obj" is an object in "context_add_value". */
     assert(YAJL_IS_OBJECT(obj));
 
-    tmpk = realloc((void *) obj->u.object.keys, sizeof(*(obj->u.object.keys)) * (obj->u.object.len + 1));
-    if (tmpk == NULL)
-        RETURN_ERROR(ctx, ENOMEM, "Out of memory");
-    obj->u.object.keys = tmpk;
-
-    tmpv = realloc(obj->u.object.values, sizeof (*obj->u.object.values) * (obj->u.object.len + 1));
-    if (tmpv == NULL)
-        RETURN_ERROR(ctx, ENOMEM, "Out of memory");
-    obj->u.object.values = tmpv;
+    /* room is made for members in powers of two */
+    if (ARRAY_FULL(obj->u.object.len))
+    {
+        size_t room = ARRAY_ROOM(obj->u.object.len);
+
+        tmpk = YA_REALLOC(ctx->alloc, (void *) obj->u.object.keys,
+                          sizeof(*(obj->u.object.keys)) * room);
+        if (tmpk == NULL)
+            RETURN_ERROR(ctx, ENOMEM, "Out of memory");
+        obj->u.object.keys = tmpk;
+
+        tmpv = YA_REALLOC(ctx->alloc, obj->u.object.values,
+                          sizeof (*obj->u.object.values) * room);
+        if (tmpv == NULL)
+            RETURN_ERROR(ctx, ENOMEM, "Out of memory");
+        obj->u.object.values = tmpv;
+    }
 
     obj->u.object.keys[obj->u.object.len] = key;
     obj->u.object.values[obj->u.object.len] = value;
@@ -195,11 +209,15 @@ static int array_add_value (context_t *ctx,
     /* "context_add_value" will only call us with array values. */
     assert(YAJL_IS_ARRAY(array));
     
-    tmp = realloc(array->u.array.values,
-                  sizeof(*(array->u.array.values)) * (array->u.array.len + 1));
-    if (tmp == NULL)
-        RETURN_ERROR(ctx, ENOMEM, "Out of memory");
-    array->u.array.values = tmp;
+    if (ARRAY_FULL(array->u.array.len))
+    {
+        tmp = YA_REALLOC(ctx->alloc, array->u.array.values,
+                         sizeof(*(array->u.array.values)) *
+                         ARRAY_ROOM(array->u.array.len));
+        if (tmp == NULL)
+            RETURN_ERROR(ctx, ENOMEM, "Out of memory");
+        array->u.array.values = tmp;
+    }
     array->u.array.values[array->u.array.len] = value;
     array->u.array.len++;
 
@@ -244,7 +262,7 @@ static int context_add_value (context_t *ctx, yajl_val v)
 
             ctx->stack->key = v->u.string;
             v->u.string = NULL;
-            free(v);
+            YA_FREE(ctx->alloc, v);
             return (0);
         }
         else /* if (ctx->key != NULL) */
@@ -268,23 +286,32 @@ static int context_add_value (context_t *ctx, yajl_val v)
     }
 }
 
+static unsigned char *handle_string_alloc (void *ctx, size_t string_length)
+{
+    unsigned char *string;
+
+    string = YA_MALLOC (((context_t *) ctx)->alloc, string_length + 1);
+    if (string == NULL)
+        RETURN_ERROR ((context_t *) ctx, NULL, "Out of memory");
+
+    return (string);
+}
+
 static int handle_string (void *ctx,
                           const unsigned char *string, size_t string_length)
 {
     yajl_val v;
 
-    v = value_alloc (yajl_t_string);
+    /* the string was decoded straight into memory from
+     * handle_string_alloc, which the value takes over */
+    v = value_alloc (ctx, yajl_t_string);
     if (v == NULL)
-        RETURN_ERROR ((context_t *) ctx, STATUS_ABORT, "Out of memory");
-
-    v->u.string = malloc (string_length + 1);
-    if (v->u.string == NULL)
     {
-        free (v);
+        YA_FREE (((context_t *) ctx)->alloc, (void *) string);
         RETURN_ERROR ((context_t *) ctx, STATUS_ABORT, "Out of memory");
     }
-    memcpy(v->u.string, string, string_length);
-    v->u.string[string_length] = 0;
+
+    v->u.string = (char *) string;
 
     return ((context_add_value (ctx, v) == 0) ? STATUS_CONTINUE : STATUS_ABORT);
 }
@@ -294,14 +321,14 @@ static int handle_number (void *ctx, const char *string, size_t string_length)
     yajl_val v;
     char *endptr;
 
-    v = value_alloc(yajl_t_number);
+    v = value_alloc(ctx, yajl_t_number);
     if (v == NULL)
         RETURN_ERROR((context_t *) ctx, STATUS_ABORT, "Out of memory");
 
-    v->u.number.r = malloc(string_length + 1);
+    v->u.number.r = YA_MALLOC(((context_t *) ctx)->alloc, string_length + 1);
     if (v->u.number.r == NULL)
     {
-        free(v);
+        YA_FREE(((context_t *) ctx)->alloc, v);
         RETURN_ERROR((context_t *) ctx, STATUS_ABORT, "Out of memory");
     }
     memcpy(v->u.number.r, string, string_length);
@@ -328,7 +355,7 @@ static int handle_start_map (void *ctx)
 {
     yajl_val v;
 
-    v = value_alloc(yajl_t_object);
+    v = value_alloc(ctx, yajl_t_object);
     if (v == NULL)
         RETURN_ERROR ((context_t *) ctx, STATUS_ABORT, "Out of memory");
 
@@ -354,7 +381,7 @@ static int handle_start_array (void *ctx)
 {
     yajl_val v;
 
-    v = value_alloc(yajl_t_array);
+    v = value_alloc(ctx, yajl_t_array);
     if (v == NULL)
         RETURN_ERROR ((context_t *) ctx, STATUS_ABORT, "Out of memory");
 
@@ -379,7 +406,7 @@ static int handle_boolean (void *ctx, int boolean_value)
 {
     yajl_val v;
 
-    v = value_alloc (boolean_value ? yajl_t_true : yajl_t_false);
+    v = value_alloc (ctx, boolean_value ? yajl_t_true : yajl_t_false);
     if (v == NULL)
         RETURN_ERROR ((context_t *) ctx, STATUS_ABORT, "Out of memory");
 
@@ -390,7 +417,7 @@ static int handle_null (void *ctx)
 {
     yajl_val v;
 
-    v = value_alloc (yajl_t_null);
+    v = value_alloc (ctx, yajl_t_null);
     if (v == NULL)
         RETURN_ERROR ((context_t *) ctx, STATUS_ABORT, "Out of memory");
 
@@ -402,6 +429,13 @@ static int handle_null (void *ctx)
  */
 yajl_val yajl_tree_parse (const char *input,
                           char *error_buffer, size_t error_buffer_size)
+{
+    return (yajl_tree_parse_alloc (input, NULL,
+                                   error_buffer, error_buffer_size));
+}
+
+yajl_val yajl_tree_parse_alloc (const char *input, yajl_alloc_funcs *afs,
+                                char *error_buffer, size_t error_buffer_size)
 {
     static const yajl_callbacks callbacks =
         {
@@ -421,16 +455,24 @@ yajl_val yajl_tree_parse (const char *input,
     yajl_handle handle;
     yajl_status status;
     char * internal_err_str;
-	context_t ctx = { NULL, NULL, NULL, 0 };
+    yajl_alloc_funcs afsBuffer;
+	context_t ctx = { NULL, NULL, NULL, 0, NULL };
 
 	ctx.errbuf = error_buffer;
 	ctx.errbuf_size = error_buffer_size;
 
+    if (afs == NULL) {
+        yajl_set_default_alloc_funcs(&afsBuffer);
+        afs = &afsBuffer;
+    }
+    ctx.alloc = afs;
+
     if (error_buffer != NULL)
         memset (error_buffer, 0, error_buffer_size);
 
-    handle = yajl_alloc (&callbacks, NULL, &ctx);
+    handle = yajl_alloc (&callbacks, afs, &ctx);
     yajl_config(handle, yajl_allow_comments, 1);
+    yajl_config(handle, yajl_string_alloc, handle_string_alloc);
 
     status = yajl_parse(handle,
                         (unsigned char *) input,
@@ -475,29 +517,37 @@ yajl_val yajl_tree_get(yajl_val n, const char ** path, yajl_type type)
 }
 
 void yajl_tree_free (yajl_val v)
+{
+    yajl_alloc_funcs afs;
+
+    yajl_set_default_alloc_funcs(&afs);
+    yajl_tree_free_alloc(v, &afs);
+}
+
+void yajl_tree_free_alloc (yajl_val v, yajl_alloc_funcs *afs)
 {
     if (v == NULL) return;
 
     if (YAJL_IS_STRING(v))
     {
-        free(v->u.string);
-        free(v);
+        YA_FREE(afs, v->u.string);
+        YA_FREE(afs, v);
     }
     else if (YAJL_IS_NUMBER(v))
     {
-        free(v->u.number.r);
-        free(v);
+        YA_FREE(afs, v->u.number.r);
+        YA_FREE(afs, v);
     }
     else if (YAJL_GET_OBJECT(v))
     {
-        yajl_object_free(v);
+        yajl_object_free(v, afs);
     }
     else if (YAJL_GET_ARRAY(v))
     {
-        yajl_array_free(v);
+        yajl_array_free(v, afs);
     }
     else /* if (yajl_t_true or yajl_t_false or yajl_t_null) */
     {
-        free(v);
+        YA_FREE(afs, v);
     }
 }
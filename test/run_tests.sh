@@ -41,6 +41,7 @@ for file in cases/*.json ; do
   allowGarbage=""
   allowMultiple=""
   allowPartials=""
+  minify=""
 
   # if the filename starts with dc_, we disallow comments for this test
   case $(basename $file) in
@@ -56,6 +57,11 @@ for file in cases/*.json ; do
     ap_*)
      allowPartials="-p ";
     ;;
+    mi_*)
+     # minified, and with comments allowed so that dropping them is tested
+     minify="-M ";
+     allowComments="-c ";
+    ;;
   esac
   fileShort=`basename $file`
   testName=`echo $fileShort | sed -e 's/\.json$//'`
@@ -64,10 +70,10 @@ for file in cases/*.json ; do
   iter=1
   success="SUCCESS"
 
-  # ${ECHO} -n "$testBinShort $allowPartials$allowComments$allowGarbage$allowMultiple-b $iter < $fileShort > ${fileShort}.test : "
+  # ${ECHO} -n "$testBinShort $allowPartials$allowComments$allowGarbage$allowMultiple$minify-b $iter < $fileShort > ${fileShort}.test : "
   # parse with a read buffer size ranging from 1-31 to stress stream parsing
   while [ $iter -lt 32  ] && [ $success = "SUCCESS" ] ; do
-    $testBin $allowPartials $allowComments $allowGarbage $allowMultiple -b $iter < $file > ${file}.test  2>&1
+    $testBin $allowPartials $allowComments $allowGarbage $allowMultiple $minify -b $iter < $file > ${file}.test  2>&1
     diff ${DIFF_FLAGS} ${file}.gold ${file}.test > ${file}.out
     if [ $? -eq 0 ] ; then
       if [ $iter -eq 31 ] ; then : $(( testsSucceeded += 1)) ; fi
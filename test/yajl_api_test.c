@@ -0,0 +1,650 @@
+/*
+ * Copyright (c) 2007-2011, Lloyd Hilaiel <lloyd@hilaiel.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/*
+ * Tests of library features which the cases in cases/ can't express,
+ * because they are reached through the API rather than by parsing a
+ * document: output sinks, allocators, limits and statistics.  Each test
+ * prints its failed checks, and the exit status is the number of tests
+ * which failed.
+ */
+
+#include <yajl/yajl_parse.h>
+#include <yajl/yajl_gen.h>
+#include <yajl/yajl_tree.h>
+#include <yajl/yajl_arena.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures;
+
+#define CHECK(cond)                                                      \
+    do {                                                                 \
+        if (!(cond)) {                                                   \
+            printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__,    \
+                   #cond);                                               \
+            failures++;                                                  \
+        }                                                                \
+    } while (0)
+
+/* compare what a generator has in its buffer with what's expected */
+static int
+gen_output_is(yajl_gen g, const char * expected)
+{
+    const unsigned char * buf;
+    size_t len;
+
+    if (yajl_gen_get_buf(g, &buf, &len) != yajl_gen_status_ok) return 0;
+    return len == strlen(expected) && !memcmp(buf, expected, len);
+}
+
+static void
+test_string_streaming(void)
+{
+    yajl_gen g = yajl_gen_alloc(NULL);
+    /* e acute, split across appends */
+    const unsigned char e[] = { 0xc3, 0xa9 };
+
+    yajl_gen_config(g, yajl_gen_validate_utf8, 1);
+    CHECK(yajl_gen_string_append(g, (const unsigned char *) "x", 1) ==
+          yajl_gen_no_string_in_progress);
+    CHECK(yajl_gen_map_open(g) == yajl_gen_status_ok);
+    CHECK(yajl_gen_string_begin(g) == yajl_gen_status_ok);
+    CHECK(yajl_gen_string_append(g, (const unsigned char *) "ke", 2) ==
+          yajl_gen_status_ok);
+    CHECK(yajl_gen_string_append(g, (const unsigned char *) "y", 1) ==
+          yajl_gen_status_ok);
+    CHECK(yajl_gen_integer(g, 1) == yajl_gen_string_in_progress);
+    CHECK(yajl_gen_string_end(g) == yajl_gen_status_ok);
+    CHECK(yajl_gen_string_begin(g) == yajl_gen_status_ok);
+    CHECK(yajl_gen_string_append(g, (const unsigned char *) "a\"\n", 3) ==
+          yajl_gen_status_ok);
+    CHECK(yajl_gen_string_append(g, e, 1) == yajl_gen_status_ok);
+    /* the string can't end half way through a character */
+    CHECK(yajl_gen_string_end(g) == yajl_gen_invalid_string);
+    CHECK(yajl_gen_string_append(g, e + 1, 1) == yajl_gen_status_ok);
+    CHECK(yajl_gen_string_append(g, (const unsigned char *) "\xff", 1) ==
+          yajl_gen_invalid_string);
+    CHECK(yajl_gen_string_end(g) == yajl_gen_status_ok);
+    CHECK(yajl_gen_map_close(g) == yajl_gen_status_ok);
+    CHECK(gen_output_is(g, "{\"key\":\"a\\\"\\n\xc3\xa9\"}"));
+    yajl_gen_free(g);
+}
+
+static void
+test_fixed_buffer(void)
+{
+    yajl_gen g = yajl_gen_alloc(NULL);
+    unsigned char buf[8];
+    char out[64];
+    size_t outLen = 0;
+    const char * words[] = { "hello", "fixed", "world" };
+    unsigned int i, full = 0;
+
+    CHECK(yajl_gen_config(g, yajl_gen_output_buffer, buf, sizeof(buf)));
+    CHECK(yajl_gen_array_open(g) == yajl_gen_status_ok);
+    for (i = 0; i < 4; i++) {
+        yajl_gen_status s = (i < 3) ?
+            yajl_gen_string(g, (const unsigned char *) words[i],
+                            strlen(words[i])) :
+            yajl_gen_array_close(g);
+
+        if (s == yajl_gen_buffer_full) {
+            const unsigned char * b;
+            size_t len;
+
+            /* the failed call wrote nothing: drain, rewind and retry */
+            full++;
+            CHECK(yajl_gen_get_buf(g, &b, &len) == yajl_gen_status_ok);
+            CHECK(b == buf && len <= sizeof(buf));
+            memcpy(out + outLen, b, len);
+            outLen += len;
+            yajl_gen_clear(g);
+            i--;
+            continue;
+        }
+        CHECK(s == yajl_gen_status_ok);
+    }
+    {
+        const unsigned char * b;
+        size_t len;
+        CHECK(yajl_gen_get_buf(g, &b, &len) == yajl_gen_status_ok);
+        memcpy(out + outLen, b, len);
+        outLen += len;
+    }
+    CHECK(full > 0);
+    CHECK(outLen == 25 && !memcmp(out, "[\"hello\",\"fixed\",\"world\"]", 25));
+    yajl_gen_free(g);
+}
+
+static void
+test_iovec(void)
+{
+    yajl_gen g = yajl_gen_alloc(NULL);
+    const yajl_gen_iovec * iov;
+    char big[100], expected[128], out[128];
+    size_t count, i, len = 0;
+    int referenced = 0;
+
+    memset(big, 'b', sizeof(big));
+    sprintf(expected, "[\"%.*s\",1]", (int) sizeof(big), big);
+
+    CHECK(yajl_gen_get_iovec(g, &iov, &count) == yajl_gen_no_buf);
+    CHECK(yajl_gen_config(g, yajl_gen_iovec_output, (size_t) 16));
+    yajl_gen_array_open(g);
+    yajl_gen_string(g, (const unsigned char *) big, sizeof(big));
+    yajl_gen_integer(g, 1);
+    yajl_gen_array_close(g);
+
+    CHECK(yajl_gen_get_iovec(g, &iov, &count) == yajl_gen_status_ok);
+    for (i = 0; i < count && len + iov[i].iov_len < sizeof(out); i++) {
+        memcpy(out + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+        /* the long string is referenced, not copied */
+        if (iov[i].iov_base == big) referenced = 1;
+    }
+    CHECK(referenced);
+    CHECK(len == strlen(expected) && !memcmp(out, expected, len));
+    yajl_gen_free(g);
+}
+
+static void
+test_splice(void)
+{
+    yajl_gen g = yajl_gen_alloc(NULL);
+    yajl_gen frag = yajl_gen_alloc_fragment(NULL, yajl_gen_fragment_array, 1);
+    yajl_gen keys = yajl_gen_alloc_fragment(NULL, yajl_gen_fragment_object,
+                                            1);
+
+    yajl_gen_integer(frag, 1);
+    yajl_gen_integer(frag, 2);
+    CHECK(yajl_gen_array_close(frag) == yajl_gen_fragment_mismatch);
+    yajl_gen_string(keys, (const unsigned char *) "k", 1);
+    yajl_gen_null(keys);
+
+    yajl_gen_array_open(g);
+    yajl_gen_integer(g, 0);
+    CHECK(yajl_gen_splice(g, frag) == yajl_gen_status_ok);
+    CHECK(yajl_gen_splice(g, keys) == yajl_gen_fragment_mismatch);
+    yajl_gen_clear(frag);
+    yajl_gen_integer(frag, 3);
+    CHECK(yajl_gen_splice(g, frag) == yajl_gen_status_ok);
+    yajl_gen_array_close(g);
+    CHECK(gen_output_is(g, "[0,1,2,3]"));
+    yajl_gen_free(g);
+
+    g = yajl_gen_alloc(NULL);
+    yajl_gen_map_open(g);
+    CHECK(yajl_gen_splice(g, frag) == yajl_gen_fragment_mismatch);
+    CHECK(yajl_gen_splice(g, keys) == yajl_gen_status_ok);
+    yajl_gen_string(g, (const unsigned char *) "z", 1);
+    CHECK(yajl_gen_splice(g, keys) == yajl_gen_fragment_mismatch);
+    yajl_gen_integer(g, 0);
+    CHECK(yajl_gen_splice(g, keys) == yajl_gen_status_ok);
+    yajl_gen_map_close(g);
+    CHECK(gen_output_is(g, "{\"k\":null,\"z\":0,\"k\":null}"));
+
+    yajl_gen_free(g);
+    yajl_gen_free(frag);
+    yajl_gen_free(keys);
+}
+
+static void
+test_gen_depth(void)
+{
+    yajl_gen g = yajl_gen_alloc(NULL);
+    unsigned int i;
+
+    /* the default limit */
+    for (i = 1; i < YAJL_MAX_DEPTH; i++) {
+        CHECK(yajl_gen_array_open(g) == yajl_gen_status_ok);
+    }
+    CHECK(yajl_gen_array_open(g) == yajl_max_depth_exceeded);
+    yajl_gen_free(g);
+
+    g = yajl_gen_alloc(NULL);
+    CHECK(yajl_gen_config(g, yajl_gen_max_depth, 3u));
+    CHECK(yajl_gen_array_open(g) == yajl_gen_status_ok);
+    CHECK(yajl_gen_map_open(g) == yajl_gen_status_ok);
+    CHECK(yajl_gen_string(g, (const unsigned char *) "a", 1) ==
+          yajl_gen_status_ok);
+    CHECK(yajl_gen_array_open(g) == yajl_max_depth_exceeded);
+    yajl_gen_free(g);
+
+    /* no limit, and the state stack grows to fit */
+    g = yajl_gen_alloc(NULL);
+    CHECK(yajl_gen_config(g, yajl_gen_max_depth, 0u));
+    for (i = 0; i < 10000; i++) {
+        CHECK(yajl_gen_array_open(g) == yajl_gen_status_ok);
+    }
+    for (i = 0; i < 10000; i++) {
+        CHECK(yajl_gen_array_close(g) == yajl_gen_status_ok);
+    }
+    CHECK(yajl_gen_integer(g, 1) == yajl_gen_generation_complete);
+    yajl_gen_free(g);
+}
+
+static void
+test_gzip(void)
+{
+    yajl_gen g = yajl_gen_alloc(NULL);
+    const unsigned char * buf;
+    size_t len, inputLen = 0;
+    unsigned int i;
+
+    if (!yajl_gen_config(g, yajl_gen_gzip_output, 6)) {
+        printf("  built without zlib, skipped\n");
+        yajl_gen_free(g);
+        return;
+    }
+    yajl_gen_array_open(g);
+    for (i = 0; i < 1000; i++) yajl_gen_integer(g, i);
+    yajl_gen_array_close(g);
+    /* [0,1,...,999] */
+    inputLen = 2 + 10 + 90 * 2 + 900 * 3 + 999;
+
+    CHECK(yajl_gen_get_buf(g, &buf, &len) == yajl_gen_status_ok);
+    /* a gzip member, ended with the length of what it holds */
+    CHECK(len > 18 && len < inputLen);
+    CHECK(len > 18 && buf[0] == 0x1f && buf[1] == 0x8b && buf[2] == 8);
+    CHECK(len > 18 && (buf[len - 4] | (buf[len - 3] << 8) |
+                       (buf[len - 2] << 16) |
+                       ((size_t) buf[len - 1] << 24)) == inputLen);
+    yajl_gen_free(g);
+
+    /* not with a fixed buffer */
+    g = yajl_gen_alloc(NULL);
+    {
+        unsigned char fixed[64];
+        yajl_gen_config(g, yajl_gen_output_buffer, fixed, sizeof(fixed));
+        CHECK(!yajl_gen_config(g, yajl_gen_gzip_output, 6));
+    }
+    yajl_gen_free(g);
+}
+
+/* parse all of text in one call */
+static yajl_status
+parse_text(yajl_handle h, const char * text)
+{
+    yajl_status s = yajl_parse(h, (const unsigned char *) text,
+                               strlen(text));
+    return (s == yajl_status_ok) ? yajl_complete_parse(h) : s;
+}
+
+/* client memory for decoded strings, handed out from a fixed block */
+typedef struct {
+    unsigned char block[256];
+    size_t used;
+    const unsigned char * last;
+    size_t lastLen;
+} string_memory;
+
+static unsigned char *
+string_memory_alloc(void * ctx, size_t len)
+{
+    string_memory * m = (string_memory *) ctx;
+    unsigned char * p;
+
+    if (m->used + len + 1 > sizeof(m->block)) return NULL;
+    p = m->block + m->used;
+    m->used += len + 1;
+    return p;
+}
+
+static int
+string_memory_string(void * ctx, const unsigned char * s, size_t len)
+{
+    string_memory * m = (string_memory *) ctx;
+    m->last = s;
+    m->lastLen = len;
+    return 1;
+}
+
+static void
+test_string_alloc(void)
+{
+    yajl_callbacks cbs;
+    string_memory m;
+    yajl_handle h;
+    char big[300];
+    unsigned char * err;
+
+    memset((void *) &cbs, 0, sizeof(cbs));
+    cbs.yajl_string = string_memory_string;
+    memset((void *) &m, 0, sizeof(m));
+
+    h = yajl_alloc(&cbs, NULL, &m);
+    CHECK(yajl_config(h, yajl_string_alloc, string_memory_alloc));
+    CHECK(parse_text(h, "[\"plain\", \"a\\tb\\u00e9\"]") == yajl_status_ok);
+    /* the second string, decoded into client memory and terminated */
+    CHECK(m.last == m.block + 6);
+    CHECK(m.lastLen == 5 && !strcmp((const char *) m.last, "a\tb\xc3\xa9"));
+    CHECK(!strcmp((const char *) m.block, "plain"));
+    yajl_free(h);
+
+    /* running out fails the parse, rather than cancelling it */
+    memset(big, 'x', sizeof(big));
+    big[0] = big[sizeof(big) - 2] = '"';
+    big[sizeof(big) - 1] = 0;
+    memset((void *) &m, 0, sizeof(m));
+    h = yajl_alloc(&cbs, NULL, &m);
+    yajl_config(h, yajl_string_alloc, string_memory_alloc);
+    CHECK(parse_text(h, big) == yajl_status_error);
+    err = yajl_get_error(h, 0, NULL, 0);
+    CHECK(strstr((const char *) err, "cancelled") == NULL);
+    yajl_free_error(h, err);
+    yajl_free(h);
+}
+
+static void
+test_handle_pool(void)
+{
+    yajl_handle_pool pool = yajl_handle_pool_alloc(NULL, NULL, 1);
+    yajl_handle a, b, c;
+
+    a = yajl_handle_pool_get(pool, NULL);
+    CHECK(yajl_config(a, yajl_allow_comments, 1));
+    CHECK(parse_text(a, "[1, /* two */ 2]") == yajl_status_ok);
+    yajl_handle_pool_put(pool, a);
+
+    /* the same handle back, reset with its options off */
+    b = yajl_handle_pool_get(pool, NULL);
+    CHECK(b == a);
+    CHECK(parse_text(b, "[1, /* two */ 2]") == yajl_status_error);
+
+    /* a second handle while the first is out, freed when the pool is full
+     * as it comes back */
+    c = yajl_handle_pool_get(pool, NULL);
+    CHECK(c != b);
+    CHECK(parse_text(c, "{\"a\": [true]}") == yajl_status_ok);
+    yajl_handle_pool_put(pool, b);
+    yajl_handle_pool_put(pool, c);
+    yajl_handle_pool_free(pool);
+}
+
+static void
+test_arena(void)
+{
+    yajl_arena arena = yajl_arena_alloc(NULL, 1024);
+    yajl_alloc_funcs afs;
+    yajl_arena_mark mark;
+    yajl_val tree;
+    const char * path[] = { "list", NULL };
+    void * first = NULL;
+    char * p, * q;
+    unsigned int i;
+
+    yajl_arena_get_alloc_funcs(arena, &afs);
+
+    /* growing the latest allocation happens in place */
+    p = (char *) afs.malloc(afs.ctx, 16);
+    q = (char *) afs.realloc(afs.ctx, p, 64);
+    CHECK(p == q);
+
+    mark = yajl_arena_get_mark(arena);
+    for (i = 0; i < 3; i++) {
+        void * probe = afs.malloc(afs.ctx, 8);
+
+        /* a reset gives the memory back, so each pass reuses it */
+        if (i == 0) first = probe;
+        CHECK(probe == first);
+        tree = yajl_tree_parse_alloc("{\"list\": [1, \"two\", [3]]}", &afs,
+                                     NULL, 0);
+        CHECK(YAJL_IS_ARRAY(yajl_tree_get(tree, path, yajl_t_array)));
+        CHECK(tree && yajl_tree_get(tree, path,
+                                    yajl_t_array)->u.array.len == 3);
+        yajl_arena_reset(arena, &mark);
+    }
+
+    /* allocations larger than a block get one of their own */
+    p = (char *) afs.malloc(afs.ctx, 4096);
+    CHECK(p != NULL);
+    if (p) memset(p, 0, 4096);
+    yajl_arena_clear(arena);
+    yajl_arena_free(arena);
+}
+
+/* a document with one string of len bytes */
+static char *
+long_string_doc(size_t len)
+{
+    char * doc = (char *) malloc(len + 5);
+    doc[0] = '[';
+    doc[1] = '"';
+    memset(doc + 2, 's', len);
+    strcpy(doc + 2 + len, "\"]");
+    return doc;
+}
+
+static void
+test_memory_limit(void)
+{
+    char * doc = long_string_doc(100000);
+    yajl_handle h;
+    unsigned char * err;
+
+    /* a long token split across calls is gathered in the lexer's buffer,
+     * which the limit stops growing */
+    h = yajl_alloc(NULL, NULL, NULL);
+    CHECK(yajl_config(h, yajl_max_memory, (size_t) 16384));
+    CHECK(yajl_parse(h, (const unsigned char *) doc, 50000) ==
+          yajl_status_memory_limit);
+    CHECK(yajl_complete_parse(h) != yajl_status_ok);
+    err = yajl_get_error(h, 0, NULL, 0);
+    CHECK(strstr((const char *) err, "memory limit") != NULL);
+    yajl_free_error(h, err);
+    yajl_free(h);
+
+    /* small documents are unaffected */
+    h = yajl_alloc(NULL, NULL, NULL);
+    yajl_config(h, yajl_max_memory, (size_t) 16384);
+    CHECK(parse_text(h, "{\"small\": [1, 2, 3]}") == yajl_status_ok);
+    yajl_free(h);
+    free(doc);
+}
+
+static void
+test_trim(void)
+{
+    char * doc = long_string_doc(100000);
+    yajl_mem_tracker tracker;
+    yajl_handle h;
+    size_t peak;
+
+    yajl_mem_tracker_init(&tracker, NULL);
+    h = yajl_alloc(NULL, &tracker.funcs, NULL);
+    CHECK(yajl_config(h, yajl_trim_buffers, (size_t) 1024));
+    CHECK(yajl_parse(h, (const unsigned char *) doc, 50000) ==
+          yajl_status_ok);
+    CHECK(yajl_parse(h, (const unsigned char *) doc + 50000,
+                     strlen(doc) - 50000) == yajl_status_ok);
+    CHECK(yajl_complete_parse(h) == yajl_status_ok);
+    /* the buffer grown for the string has been given back */
+    peak = tracker.stats.peakBytes;
+    CHECK(peak > 50000);
+    CHECK(tracker.stats.bytes < 16384);
+    yajl_free(h);
+    CHECK(tracker.stats.bytes == 0);
+    free(doc);
+}
+
+static void
+test_mem_stats(void)
+{
+    yajl_mem_tracker tracker;
+    yajl_mem_stats stats;
+    yajl_handle h;
+    yajl_gen g;
+    yajl_val tree;
+
+    /* untracked handles and generators report nothing */
+    h = yajl_alloc(NULL, NULL, NULL);
+    yajl_get_mem_stats(h, &stats);
+    CHECK(stats.allocs == 0 && stats.bytes == 0);
+    yajl_free(h);
+
+    yajl_mem_tracker_init(&tracker, NULL);
+    h = yajl_alloc(NULL, &tracker.funcs, NULL);
+    CHECK(parse_text(h, "[\"with an \\\"escape\\\"\"]") == yajl_status_ok);
+    yajl_get_mem_stats(h, &stats);
+    CHECK(stats.allocs > 0 && stats.bytes > 0);
+    CHECK(stats.peakBytes >= stats.bytes && stats.totalBytes >= stats.bytes);
+    yajl_free(h);
+    CHECK(tracker.stats.bytes == 0);
+    CHECK(tracker.stats.frees == tracker.stats.allocs);
+
+    g = yajl_gen_alloc(&tracker.funcs);
+    yajl_gen_string(g, (const unsigned char *) "generated", 9);
+    yajl_gen_get_mem_stats(g, &stats);
+    CHECK(stats.bytes > 0);
+    yajl_gen_free(g);
+    CHECK(tracker.stats.bytes == 0);
+
+    tree = yajl_tree_parse_alloc("{\"a\": [1, 2]}", &tracker.funcs, NULL, 0);
+    CHECK(tree != NULL && tracker.stats.bytes > 0);
+    yajl_tree_free_alloc(tree, &tracker.funcs);
+    CHECK(tracker.stats.bytes == 0);
+
+    /* what a tracker hands out is aligned for any type */
+    {
+        void * p = tracker.funcs.malloc(tracker.funcs.ctx, 8);
+        CHECK(((size_t) p % sizeof(long double)) == 0);
+        tracker.funcs.free(tracker.funcs.ctx, p);
+    }
+}
+
+static void
+test_parse_stats(void)
+{
+    const char * doc = "{\"a\": [1, 2.5, true, null, \"x\\n\"]}";
+    yajl_handle h = yajl_alloc(NULL, NULL, NULL);
+    yajl_stats stats;
+    unsigned int i;
+
+    CHECK(parse_text(h, doc) == yajl_status_ok);
+    if (!yajl_get_stats(h, &stats)) {
+        printf("  built without stats, skipped\n");
+        yajl_free(h);
+        return;
+    }
+    CHECK(stats.parseCalls == 1 && stats.bytesParsed == strlen(doc));
+    CHECK(stats.integerTokens == 1 && stats.doubleTokens == 1);
+    CHECK(stats.boolTokens == 1 && stats.nullTokens == 1);
+    CHECK(stats.cleanStrings == 1 && stats.escapedStrings == 1);
+    CHECK(stats.openTokens == 2 && stats.closeTokens == 2);
+    CHECK(stats.separatorTokens == 5);
+    CHECK(stats.maxDepth == 2);
+    /* a single call isn't among those timed */
+    CHECK(stats.sampledCalls == 0);
+    yajl_free(h);
+
+    /* the 64th call is */
+    h = yajl_alloc(NULL, NULL, NULL);
+    yajl_parse(h, (const unsigned char *) "[", 1);
+    for (i = 1; i < 64; i++) yajl_parse(h, (const unsigned char *) "1,", 2);
+    CHECK(yajl_get_stats(h, &stats) && stats.sampledCalls == 1);
+    yajl_free(h);
+}
+
+/* a growing buffer for yajl_print_t output */
+typedef struct {
+    char * text;
+    size_t len;
+} test_output;
+
+static void
+test_print(void * ctx, const char * str, size_t len)
+{
+    test_output * out = (test_output *) ctx;
+    out->text = (char *) realloc(out->text, out->len + len + 1);
+    memcpy(out->text + out->len, str, len);
+    out->len += len;
+    out->text[out->len] = 0;
+}
+
+static void
+test_minify(void)
+{
+    const char * doc = "1 [2, \"a b\" ] \n { \"k\" : -3.5e2 }";
+    test_output out = { NULL, 0 };
+    yajl_handle h = yajl_alloc(NULL, NULL, NULL);
+    size_t i;
+
+    CHECK(yajl_config(h, yajl_minify, test_print, (void *) &out));
+    yajl_config(h, yajl_allow_multiple_values, 1);
+    CHECK(parse_text(h, doc) == yajl_status_ok);
+    CHECK(out.text && !strcmp(out.text, "1\n[2,\"a b\"]\n{\"k\":-3.5e2}\n"));
+    yajl_free(h);
+
+    /* the same output fed a byte at a time, when every token longer than
+     * a character is put together in the lexer */
+    free(out.text);
+    out.text = NULL;
+    out.len = 0;
+    h = yajl_alloc(NULL, NULL, NULL);
+    yajl_config(h, yajl_minify, test_print, (void *) &out);
+    yajl_config(h, yajl_allow_multiple_values, 1);
+    for (i = 0; doc[i]; i++) {
+        CHECK(yajl_parse(h, (const unsigned char *) doc + i, 1) ==
+              yajl_status_ok);
+    }
+    CHECK(yajl_complete_parse(h) == yajl_status_ok);
+    CHECK(out.text && !strcmp(out.text, "1\n[2,\"a b\"]\n{\"k\":-3.5e2}\n"));
+    yajl_free(h);
+    free(out.text);
+}
+
+static const struct {
+    const char * name;
+    void (*test)(void);
+} tests[] = {
+    { "string_streaming", test_string_streaming },
+    { "fixed_buffer", test_fixed_buffer },
+    { "iovec", test_iovec },
+    { "splice", test_splice },
+    { "gen_depth", test_gen_depth },
+    { "gzip", test_gzip },
+    { "string_alloc", test_string_alloc },
+    { "handle_pool", test_handle_pool },
+    { "arena", test_arena },
+    { "memory_limit", test_memory_limit },
+    { "trim", test_trim },
+    { "mem_stats", test_mem_stats },
+    { "parse_stats", test_parse_stats },
+    { "minify", test_minify }
+};
+
+#define NUM_TESTS (sizeof(tests) / sizeof(tests[0]))
+
+int
+main(int argc, char ** argv)
+{
+    unsigned int i, failed = 0;
+
+    for (i = 0; i < NUM_TESTS; i++) {
+        int before = failures;
+
+        printf("%s\n", tests[i].name);
+        tests[i].test();
+        if (failures != before) failed++;
+    }
+    printf("%u/%u api tests successful\n", (unsigned int) NUM_TESTS - failed,
+           (unsigned int) NUM_TESTS);
+    return failed ? 1 : 0;
+}
@@ -148,6 +148,22 @@ static yajl_callbacks callbacks = {
     test_yajl_end_array
 };
 
+/* minified output, collected to be printed once parsing is done so that
+ * it doesn't depend on the read buffer size */
+typedef struct
+{
+    char * text;
+    size_t len;
+} yajlTestMinified;
+
+static void test_minify_print(void * ctx, const char * str, size_t len)
+{
+    yajlTestMinified * m = (yajlTestMinified *) ctx;
+    m->text = (char *) realloc(m->text, m->len + len);
+    memcpy(m->text + m->len, str, len);
+    m->len += len;
+}
+
 static void usage(const char * progname)
 {
     fprintf(stderr,
@@ -159,6 +175,7 @@ static void usage(const char * progname)
             "   -g  allow *g*arbage after valid JSON text\n"
             "   -m  allows the parser to consume multiple JSON values\n"
             "       from a single string separated by whitespace\n"
+            "   -M  print the input minified as well\n"
             "   -p  partial JSON documents should not cause errors\n",
             progname);
     exit(1);
@@ -178,6 +195,7 @@ main(int argc, char ** argv)
     /* memory allocation debugging: allocate a structure which collects
      * statistics */
     yajlTestMemoryContext memCtx = { 0,0 };
+    yajlTestMinified minified = { NULL, 0 };
 
     /* memory allocation debugging: allocate a structure which holds
      * allocation routines */
@@ -217,6 +235,9 @@ main(int argc, char ** argv)
             yajl_config(hand, yajl_allow_trailing_garbage, 1);
         } else if (!strcmp("-m", argv[i])) {
             yajl_config(hand, yajl_allow_multiple_values, 1);
+        } else if (!strcmp("-M", argv[i])) {
+            yajl_config(hand, yajl_minify, test_minify_print,
+                        (void *) &minified);
         } else if (!strcmp("-p", argv[i])) {
             yajl_config(hand, yajl_allow_partial_values, 1);
         } else {
@@ -254,6 +275,12 @@ main(int argc, char ** argv)
     }
 
     stat = yajl_complete_parse(hand);
+    if (minified.text) {
+        printf("minified: '");
+        fwrite(minified.text, 1, minified.len, stdout);
+        printf("'\n");
+        free(minified.text);
+    }
     if (stat != yajl_status_ok)
     {
         unsigned char * str = yajl_get_error(hand, 0, fileData, rd);
@@ -14,37 +14,536 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+/* seeking large files, walking directories, threads and the monotonic
+ * clock are POSIX, beyond the c99 this is built as */
+#ifndef WIN32
+#  define _POSIX_C_SOURCE 200112L
+#  define _FILE_OFFSET_BITS 64
+#endif
+
 #include <yajl/yajl_parse.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#ifdef WIN32
+#  define verify_seek(f, off) _fseeki64((f), (__int64) (off), SEEK_SET)
+#else
+#  include <dirent.h>
+#  include <pthread.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#  define verify_seek(f, off) fseeko((f), (off_t) (off), SEEK_SET)
+#endif
+
+/* input is read this much at a time */
+#define VERIFY_BUF_SIZE (1024 * 1024)
+
+/* line delimited files larger than this are split into ranges of about
+ * this size, which are verified in parallel */
+#define VERIFY_SPLIT_SIZE (64 * 1024 * 1024)
+
+#define VERIFY_NO_END ((unsigned long long) -1)
+
+typedef enum {
+    verify_valid = 0,
+    verify_invalid,
+    verify_unreadable
+} verify_status;
+
+/* a file, or part of one, for a worker to verify.  in line delimited
+ * mode a task verifies the lines that begin in its range */
+typedef struct {
+    size_t file;
+    unsigned long long start;
+    unsigned long long end;
+    verify_status status;
+    /* lines begun and documents verified */
+    unsigned long long lines;
+    unsigned long long docs;
+    unsigned long long bytes;
+    /* where the first error is, the line counting from the task's first */
+    unsigned long long errorOffset;
+    unsigned long long errorLine;
+    char * message;
+} verify_task;
+
+typedef struct {
+    /* NULL for stdin */
+    char * path;
+    size_t firstTask;
+    size_t numTasks;
+    size_t tasksDone;
+} verify_file;
+
+typedef struct {
+    int allowComments;
+    int dontValidate;
+    int lines;
+    int quiet;
+    verify_file * files;
+    size_t numFiles;
+    size_t filesAlloc;
+    verify_task * tasks;
+    size_t numTasks;
+    size_t tasksAlloc;
+    /* the next task to hand out and the next file to report on, and
+     * totals of what has been reported */
+    size_t nextTask;
+    size_t nextReport;
+    size_t numValid;
+    size_t numInvalid;
+    unsigned long long bytes;
+    unsigned long long docs;
+#ifndef WIN32
+    pthread_mutex_t lock;
+#endif
+} verify_job;
+
+/* a worker's reusable handles and read buffer */
+typedef struct {
+    verify_job * job;
+    yajl_handle_pool pool;
+    unsigned char * buf;
+} verify_worker;
 
 static void
 usage(const char * progname)
 {
-    fprintf(stderr, "%s: validate json from stdin\n"
-                    "usage: json_verify [options]\n"
+    fprintf(stderr, "%s: validate json from stdin, or files\n"
+                    "usage: json_verify [options] [file or directory ...]\n"
                     "    -q quiet mode\n"
                     "    -c allow comments\n"
-                    "    -u allow invalid utf8 inside strings\n",
+                    "    -u allow invalid utf8 inside strings\n"
+                    "    -l treat input as line delimited json, a document\n"
+                    "       per line\n"
+                    "    -j N verify with N threads (default: one per\n"
+                    "       processor)\n"
+                    "directories are searched for files to verify.  the\n"
+                    "status of each file is printed, then a summary\n",
             progname);
     exit(1);
 }
 
+static double
+verify_now(void)
+{
+#ifdef WIN32
+    return (double) clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+#endif
+}
+
+static void
+verify_lock(verify_job * job)
+{
+#ifndef WIN32
+    pthread_mutex_lock(&(job->lock));
+#endif
+}
+
+static void
+verify_unlock(verify_job * job)
+{
+#ifndef WIN32
+    pthread_mutex_unlock(&(job->lock));
+#endif
+}
+
+static void
+add_task(verify_job * job, size_t file, unsigned long long start,
+         unsigned long long end)
+{
+    verify_task * t;
+
+    if (job->numTasks == job->tasksAlloc) {
+        job->tasksAlloc = job->tasksAlloc ? job->tasksAlloc * 2 : 64;
+        job->tasks = (verify_task *)
+            realloc(job->tasks, job->tasksAlloc * sizeof(verify_task));
+    }
+    t = job->tasks + job->numTasks++;
+    memset((void *) t, 0, sizeof(verify_task));
+    t->file = file;
+    t->start = start;
+    t->end = end;
+    job->files[file].numTasks++;
+}
+
+/* add a file to verify, as one task or, if it is a large line delimited
+ * file, a task per range */
+static void
+add_file(verify_job * job, const char * path, unsigned long long size)
+{
+    verify_file * f;
+    unsigned long long start;
+
+    if (job->numFiles == job->filesAlloc) {
+        job->filesAlloc = job->filesAlloc ? job->filesAlloc * 2 : 64;
+        job->files = (verify_file *)
+            realloc(job->files, job->filesAlloc * sizeof(verify_file));
+    }
+    f = job->files + job->numFiles++;
+    memset((void *) f, 0, sizeof(verify_file));
+    if (path) {
+        f->path = (char *) malloc(strlen(path) + 1);
+        strcpy(f->path, path);
+    }
+    f->firstTask = job->numTasks;
+
+    if (!job->lines || size <= VERIFY_SPLIT_SIZE) {
+        add_task(job, job->numFiles - 1, 0, VERIFY_NO_END);
+        return;
+    }
+    for (start = 0; start < size; start += VERIFY_SPLIT_SIZE) {
+        add_task(job, job->numFiles - 1, start,
+                 start + VERIFY_SPLIT_SIZE < size ?
+                 start + VERIFY_SPLIT_SIZE : VERIFY_NO_END);
+    }
+}
+
+#ifndef WIN32
+static int
+compare_names(const void * a, const void * b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* add a file, or the files under a directory in order of their names.
+ * anything named on the command line is verified, whatever it is, but
+ * only regular files are taken from directories, and symbolic links to
+ * directories aren't followed */
+static void
+add_path(verify_job * job, const char * path, int top)
+{
+    struct stat st;
+
+    if ((top ? stat(path, &st) : lstat(path, &st)) != 0) {
+        add_file(job, path, 0);
+        return;
+    }
+    if (S_ISLNK(st.st_mode) && (stat(path, &st) != 0 || S_ISDIR(st.st_mode)))
+    {
+        return;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        DIR * dir = opendir(path);
+        struct dirent * ent;
+        char ** names = NULL;
+        size_t numNames = 0, namesAlloc = 0, i;
+
+        if (dir == NULL) {
+            add_file(job, path, 0);
+            return;
+        }
+        while ((ent = readdir(dir)) != NULL) {
+            if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) {
+                continue;
+            }
+            if (numNames == namesAlloc) {
+                namesAlloc = namesAlloc ? namesAlloc * 2 : 64;
+                names = (char **)
+                    realloc(names, namesAlloc * sizeof(char *));
+            }
+            names[numNames] = (char *)
+                malloc(strlen(path) + strlen(ent->d_name) + 2);
+            sprintf(names[numNames++], "%s/%s", path, ent->d_name);
+        }
+        closedir(dir);
+        if (numNames) qsort(names, numNames, sizeof(char *), compare_names);
+        for (i = 0; i < numNames; i++) {
+            add_path(job, names[i], 0);
+            free(names[i]);
+        }
+        free(names);
+    } else if (S_ISREG(st.st_mode)) {
+        add_file(job, path, (unsigned long long) st.st_size);
+    } else if (top) {
+        /* pipes and devices are read as a stream, in a single task */
+        add_file(job, path, 0);
+    }
+}
+#else
+static void
+add_path(verify_job * job, const char * path, int top)
+{
+    add_file(job, path, 0);
+}
+#endif
+
+static yajl_handle
+start_doc(verify_worker * w)
+{
+    yajl_handle hand = yajl_handle_pool_get(w->pool, NULL);
+
+    yajl_config(hand, yajl_allow_comments, w->job->allowComments);
+    yajl_config(hand, yajl_dont_validate_strings, w->job->dontValidate);
+    return hand;
+}
+
+/* note a task's first error, from a chunk of text or, when parsing is
+ * completed, without one */
+static void
+fail_task(verify_worker * w, verify_task * t, yajl_handle hand,
+          unsigned long long offset, const unsigned char * text, size_t len)
+{
+    /* stdin gets the detailed message it always has */
+    int verbose = w->job->files[t->file].path == NULL;
+    unsigned char * str = yajl_get_error(hand, verbose, text, len);
+    size_t l = strlen((const char *) str);
+
+    if (!verbose && l > 0 && str[l - 1] == '\n') l--;
+    t->status = verify_invalid;
+    t->errorOffset = offset;
+    t->errorLine = t->lines;
+    t->message = (char *) malloc(l + 1);
+    memcpy(t->message, str, l);
+    t->message[l] = 0;
+    yajl_free_error(hand, str);
+}
+
+static void
+run_task(verify_worker * w, verify_task * t)
+{
+    verify_job * job = w->job;
+    const char * path = job->files[t->file].path;
+    FILE * f = path ? fopen(path, "rb") : stdin;
+    unsigned char * buf = w->buf;
+    yajl_handle hand = NULL;
+    yajl_status stat;
+    /* the offset of buf in the file, and whether a range's partial first
+     * line is still to be skipped */
+    unsigned long long pos = t->start;
+    int skipping = 0;
+    size_t rd = 0, i, j;
+
+    if (f == NULL) {
+        t->status = verify_unreadable;
+        t->message = (char *) malloc(strlen(strerror(errno)) + 1);
+        strcpy(t->message, strerror(errno));
+        return;
+    }
+    if (path) setvbuf(f, NULL, _IONBF, 0);
+    if (t->start > 0) {
+        /* from the byte before, which tells if a line starts here */
+        pos = t->start - 1;
+        skipping = 1;
+        if (verify_seek(f, pos) != 0) goto unreadable;
+    }
+
+    for (;;) {
+        rd = fread((void *) buf, 1, VERIFY_BUF_SIZE, f);
+        if (rd == 0) {
+            if (ferror(f)) goto unreadable;
+            break;
+        }
+        t->bytes += rd;
+        i = 0;
+
+        if (!job->lines) {
+            if (hand == NULL) hand = start_doc(w);
+            stat = yajl_parse(hand, buf, rd);
+            if (stat != yajl_status_ok) {
+                fail_task(w, t, hand, pos + yajl_get_bytes_consumed(hand),
+                          buf, rd);
+                goto done;
+            }
+            pos += rd;
+            continue;
+        }
+
+        while (i < rd) {
+            const unsigned char * nl;
+
+            if (skipping) {
+                nl = (const unsigned char *) memchr(buf + i, '\n', rd - i);
+                if (nl == NULL) break;
+                i = nl - buf + 1;
+                skipping = 0;
+                continue;
+            }
+            if (hand == NULL) {
+                /* lines beginning past the range are another task's */
+                if (pos + i >= t->end) goto done;
+                nl = (const unsigned char *) memchr(buf + i, '\n', rd - i);
+                t->lines++;
+                /* blank lines are allowed */
+                if (nl == buf + i || (nl == buf + i + 1 && buf[i] == '\r')) {
+                    i = nl - buf + 1;
+                    continue;
+                }
+                hand = start_doc(w);
+            } else {
+                nl = (const unsigned char *) memchr(buf + i, '\n', rd - i);
+            }
+            j = nl ? (size_t) (nl - buf) : rd;
+
+            stat = yajl_parse(hand, buf + i, j - i);
+            if (stat == yajl_status_ok && nl) {
+                stat = yajl_complete_parse(hand);
+                if (stat != yajl_status_ok) {
+                    fail_task(w, t, hand, pos + j, buf + i, j - i);
+                    goto done;
+                }
+            } else if (stat != yajl_status_ok) {
+                fail_task(w, t, hand,
+                          pos + i + yajl_get_bytes_consumed(hand),
+                          buf + i, j - i);
+                goto done;
+            }
+            if (nl) {
+                yajl_handle_pool_put(w->pool, hand);
+                hand = NULL;
+                t->docs++;
+                j++;
+            }
+            i = j;
+        }
+        pos += rd;
+    }
+
+    /* the end of the input ends the document in progress, and in whole
+     * document mode there is always one, empty or not */
+    if (hand == NULL && !job->lines) hand = start_doc(w);
+    if (hand) {
+        stat = yajl_complete_parse(hand);
+        if (stat != yajl_status_ok) {
+            fail_task(w, t, hand, pos, buf, rd);
+        } else {
+            t->docs++;
+        }
+    }
+    goto done;
+
+  unreadable:
+    t->status = verify_unreadable;
+    t->message = (char *) malloc(strlen(strerror(errno)) + 1);
+    strcpy(t->message, strerror(errno));
+
+  done:
+    if (hand) yajl_handle_pool_put(w->pool, hand);
+    if (path) fclose(f);
+}
+
+/* report on the files whose tasks are all done, in order.  called with
+ * the job locked */
+static void
+report_files(verify_job * job)
+{
+    while (job->nextReport < job->numFiles) {
+        verify_file * f = job->files + job->nextReport;
+        verify_task * bad = NULL;
+        unsigned long long line = 0;
+        size_t k;
+
+        if (f->tasksDone < f->numTasks) break;
+        for (k = 0; k < f->numTasks; k++) {
+            verify_task * t = job->tasks + f->firstTask + k;
+            job->bytes += t->bytes;
+            job->docs += t->docs;
+            if (bad == NULL && t->status != verify_valid) {
+                bad = t;
+                line += t->errorLine;
+            } else if (bad == NULL) {
+                line += t->lines;
+            }
+        }
+
+        if (bad == NULL) {
+            job->numValid++;
+        } else {
+            job->numInvalid++;
+        }
+        if (!job->quiet) {
+            if (f->path == NULL) {
+                /* stdin, as json_verify has always reported it */
+                if (bad && bad->status == verify_unreadable) {
+                    fprintf(stderr, "error encountered on file read\n");
+                } else if (bad && job->lines) {
+                    fprintf(stderr, "line %llu: %s", line, bad->message);
+                } else if (bad) {
+                    fprintf(stderr, "%s", bad->message);
+                }
+                printf("JSON is %s\n", bad ? "invalid" : "valid");
+            } else if (bad == NULL) {
+                printf("%s: valid\n", f->path);
+            } else if (bad->status == verify_unreadable) {
+                printf("%s: unreadable: %s\n", f->path, bad->message);
+            } else if (job->lines) {
+                printf("%s: invalid at byte %llu (line %llu): %s\n",
+                       f->path, bad->errorOffset, line, bad->message);
+            } else {
+                printf("%s: invalid at byte %llu: %s\n", f->path,
+                       bad->errorOffset, bad->message);
+            }
+        }
+
+        for (k = 0; k < f->numTasks; k++) {
+            free(job->tasks[f->firstTask + k].message);
+            job->tasks[f->firstTask + k].message = NULL;
+        }
+        job->nextReport++;
+    }
+}
+
+static void *
+worker_main(void * arg)
+{
+    verify_worker * w = (verify_worker *) arg;
+    verify_job * job = w->job;
+
+    w->pool = yajl_handle_pool_alloc(NULL, NULL, 1);
+    w->buf = (unsigned char *) malloc(VERIFY_BUF_SIZE);
+    for (;;) {
+        verify_task * t;
+
+        verify_lock(job);
+        if (job->nextTask == job->numTasks) {
+            verify_unlock(job);
+            break;
+        }
+        t = job->tasks + job->nextTask++;
+        verify_unlock(job);
+
+        run_task(w, t);
+
+        verify_lock(job);
+        job->files[t->file].tasksDone++;
+        report_files(job);
+        verify_unlock(job);
+    }
+    yajl_handle_pool_free(w->pool);
+    free(w->buf);
+    return NULL;
+}
+
+static unsigned int
+num_cpus(void)
+{
+#if defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned int) n : 1;
+#else
+    return 1;
+#endif
+}
+
 int
 main(int argc, char ** argv)
 {
-    yajl_status stat;
-    size_t rd;
-    yajl_handle hand;
-    static unsigned char fileData[65536];
-    int quiet = 0;
-    int retval = 0;
+    verify_job job;
+    verify_worker * workers;
+    unsigned int threads = 0, t;
+    double start, secs;
+    size_t k;
     int a = 1;
 
-    /* allocate a parser */
-    hand = yajl_alloc(NULL, NULL, NULL);
+    memset((void *) &job, 0, sizeof(job));
 
     /* check arguments.*/
     while ((a < argc) && (argv[a][0] == '-') && (strlen(argv[a]) > 1)) {
@@ -52,13 +551,22 @@ main(int argc, char ** argv)
         for ( i=1; i < strlen(argv[a]); i++) {
             switch (argv[a][i]) {
                 case 'q':
-                    quiet = 1;
+                    job.quiet = 1;
                     break;
                 case 'c':
-                    yajl_config(hand, yajl_allow_comments, 1);
+                    job.allowComments = 1;
                     break;
                 case 'u':
-                    yajl_config(hand, yajl_dont_validate_strings, 1);
+                    job.dontValidate = 1;
+                    break;
+                case 'l':
+                    job.lines = 1;
+                    break;
+                case 'j':
+                    if (argv[a][i + 1] || a + 1 >= argc) usage(argv[0]);
+                    threads = (unsigned int) atoi(argv[++a]);
+                    if (threads == 0) usage(argv[0]);
+                    i = strlen(argv[a]);
                     break;
                 default:
                     fprintf(stderr, "unrecognized option: '%c'\n\n", argv[a][i]);
@@ -67,50 +575,68 @@ main(int argc, char ** argv)
         }
         ++a;
     }
-    if (a < argc) {
-        usage(argv[0]);
+
+    if (a == argc) add_file(&job, NULL, 0);
+    for (; a < argc; a++) add_path(&job, argv[a], 1);
+    if (job.numFiles == 0) {
+        fprintf(stderr, "no files to verify\n");
+        return 1;
     }
 
-    for (;;) {
-        rd = fread((void *) fileData, 1, sizeof(fileData) - 1, stdin);
+#ifdef WIN32
+    threads = 1;
+#else
+    if (threads == 0) threads = num_cpus();
+#endif
+    if (threads > job.numTasks) threads = (unsigned int) job.numTasks;
+    if (threads == 0) threads = 1;
+    workers = (verify_worker *) calloc(threads, sizeof(verify_worker));
 
-        retval = 0;
+    start = verify_now();
+#ifdef WIN32
+    workers[0].job = &job;
+    worker_main(workers);
+#else
+    {
+        pthread_t * ids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+        unsigned int started;
 
-        if (rd == 0) {
-            if (!feof(stdin)) {
-                if (!quiet) {
-                    fprintf(stderr, "error encountered on file read\n");
-                }
-                retval = 1;
+        pthread_mutex_init(&(job.lock), NULL);
+        workers[0].job = &job;
+        /* workers share the tasks, so if a thread can't be started the
+         * others, this one at least, do its share */
+        for (started = 1; started < threads; started++) {
+            workers[started].job = &job;
+            if (pthread_create(ids + started, NULL, worker_main,
+                               workers + started))
+            {
+                break;
             }
-            break;
         }
-        fileData[rd] = 0;
-
-        /* read file data, pass to parser */
-        stat = yajl_parse(hand, fileData, rd);
-
-        if (stat != yajl_status_ok) break;
+        /* this thread is a worker too */
+        worker_main(workers);
+        for (t = 1; t < started; t++) pthread_join(ids[t], NULL);
+        pthread_mutex_destroy(&(job.lock));
+        free(ids);
     }
+#endif
+    secs = verify_now() - start;
 
-    /* parse any remaining buffered data */
-    stat = yajl_complete_parse(hand);
-
-    if (stat != yajl_status_ok)
+    if (!job.quiet && job.numFiles > 0 &&
+        (job.numFiles > 1 || job.files[0].path != NULL))
     {
-        if (!quiet) {
-            unsigned char * str = yajl_get_error(hand, 1, fileData, rd);
-            fprintf(stderr, "%s", (const char *) str);
-            yajl_free_error(hand, str);
-        }
-        retval = 1;
+        fprintf(stderr, "%lu files: %lu valid, %lu invalid; %llu documents, "
+                "%.1f MB in %.2fs (%.1f MB/s)\n",
+                (unsigned long) job.numFiles, (unsigned long) job.numValid,
+                (unsigned long) job.numInvalid, job.docs,
+                job.bytes / (1024.0 * 1024.0), secs,
+                secs > 0 ? job.bytes / (1024.0 * 1024.0) / secs : 0.0);
     }
 
-    yajl_free(hand);
-
-    if (!quiet) {
-        printf("JSON is %s\n", retval ? "invalid" : "valid");
-    }
+    for (k = 0; k < job.numFiles; k++) free(job.files[k].path);
+    free(job.files);
+    free(job.tasks);
+    free(workers);
 
-    return retval;
+    return job.numInvalid ? 1 : 0;
 }